@@ -19,6 +19,10 @@ import kotlin.concurrent.thread
 @RunWith(AndroidJUnit4::class)
 class GlogTest {
     companion object {
+        private const val LOG_NUM = 10000
+        private const val CONTENT =
+            "_log_header_89h4fuv82h02h9jadnvp(**\$^#&>chinese29hfq9rhf982hqurfj920qhfhafjp0h2iofh09hijafa(^(*^%$%^q29hfq89uhvqwwhfqwhef892hfw8qfhq8w9efhq89hf89q2fy89qh43f892hq89"
+
         private lateinit var sRootDirectory: File
 
         @BeforeClass
@@ -46,6 +50,33 @@ class GlogTest {
         }
     }
 
+    /**
+     * write LOG_NUM logs of "$index$CONTENT" by a sync glog, return it with its archives
+     */
+    private fun writeLogs(
+        protoName: String,
+        order: Glog.FileOrder = Glog.FileOrder.CreateTimeAscending,
+        configure: Glog.Builder.() -> Unit = {}
+    ): Pair<Glog, List<String>> {
+        val appContext = InstrumentationRegistry.getInstrumentation().targetContext
+        val glog = Glog.Builder(appContext)
+            .protoName(protoName)
+            .rootDirectory(sRootDirectory.absolutePath)
+            .async(false)
+            .expireSeconds(24 * 60 * 60) // ensure native code do not clean archives
+            .totalArchiveSizeLimit(128 * 1024 * 1024)
+            .apply(configure)
+            .build()
+
+        for (i in 1..LOG_NUM) {
+            assertTrue(glog.write("$i$CONTENT".toByteArray()))
+        }
+
+        val files = arrayListOf<String>()
+        glog.getArchiveSnapshot(files, true, 0, 0, order)
+        return Pair(glog, files)
+    }
+
     @Test
     fun multiInstanceWithSameProtoNameShareSameNativePtr() {
         val appContext = InstrumentationRegistry.getInstrumentation().targetContext
@@ -83,10 +114,47 @@ class GlogTest {
         bytes = ByteArray(0)
         assertFalse(glog.write(bytes))
 
+        // longer log is split into chunks, but never longer than cache
         bytes = ByteArray(maxLength + 1)
+        assertTrue(glog.write(bytes))
+
+        bytes = ByteArray(glog.cacheSize + 1)
         assertFalse(glog.write(bytes))
     }
 
+    @Test
+    fun largeLogWriteRead() {
+        val appContext = InstrumentationRegistry.getInstrumentation().targetContext
+        val glog = Glog.Builder(appContext)
+            .protoName("glog-test-large-log")
+            .rootDirectory(sRootDirectory.absolutePath)
+            .async(false)
+            .expireSeconds(24 * 60 * 60) // ensure native code do not clean archives
+            .totalArchiveSizeLimit(128 * 1024 * 1024)
+            .build()
+
+        val maxLength = Glog.getSingleLogMaxLength()
+        val logs = (1..20).map { i -> ByteArray(if (i % 2 == 0) i else maxLength * i / 4 + i) { (it * i).toByte() } }
+        logs.forEach { assertTrue(glog.write(it)) }
+
+        val files = arrayListOf<String>()
+        glog.getArchiveSnapshot(files, true, 0, 0, Glog.FileOrder.CreateTimeAscending)
+        var index = 0
+        files.forEach { file ->
+            val reader = glog.openReader(file)
+            val buf = ByteArray(maxLength * 8)
+            while (true) {
+                val n = reader.read(buf)
+
+                if (n <= 0) break
+
+                assertArrayEquals(logs[index++], buf.copyOf(n))
+            }
+            reader.close()
+        }
+        assertEquals(logs.size, index)
+    }
+
     @Test
     fun archiveIfCacheRemainSpaceNotEnough() {
         val appContext = InstrumentationRegistry.getInstrumentation().targetContext
@@ -209,6 +277,130 @@ class GlogTest {
         assertEquals(logNum, index)
     }
 
+    @Test
+    fun resyncAfterCorruptedArchive() {
+        // records are independent, reader resyncs at next one
+        val (glog, files) = writeLogs("glog-test-resync-corrupted") { compressMode(Glog.CompressMode.None) }
+        assertEquals(1, files.size)
+
+        // overwrite 64KB in the middle with garbage
+        val corruptedLength = 64 * 1024
+        java.io.RandomAccessFile(files[0], "rw").use { file ->
+            val garbage = ByteArray(corruptedLength)
+            Random(1).nextBytes(garbage)
+            file.seek(file.length() / 2)
+            file.write(garbage)
+        }
+
+        val indexes = arrayListOf<Int>()
+        val reader = glog.openReader(files[0])
+        while (true) {
+            val buf = ByteArray(Glog.getSingleLogMaxLength())
+            val n = reader.read(buf)
+
+            if (n < 0) break
+            if (n == 0) continue // resynced at next sync marker
+
+            val log = String(buf, 0, n)
+            if (log.endsWith(CONTENT)) {
+                indexes.add(log.removeSuffix(CONTENT).toInt())
+            }
+        }
+        reader.close()
+
+        // logs before and after corrupted region are all read in order
+        assertEquals(1, indexes.first())
+        assertEquals(LOG_NUM, indexes.last())
+        for (i in 1 until indexes.size) {
+            assertTrue(indexes[i] > indexes[i - 1])
+        }
+        val lost = LOG_NUM - indexes.size
+        assertThat(lost, greaterThan(0))
+        assertThat(lost, lessThan(corruptedLength / CONTENT.length + 2))
+    }
+
+    @Test
+    fun concurrentReadersOfSameArchive() {
+        val (glog, files) = writeLogs("glog-test-concurrent-readers")
+
+        // readers of the same archive keep their own position, each thread reads all logs
+        val readNums = Array(4) { AtomicInteger(0) }
+        val threads = readNums.map { readNum ->
+            thread {
+                var index = 0
+                files.forEach { file ->
+                    val reader = glog.openReader(file)
+                    while (true) {
+                        val buf = ByteArray(Glog.getSingleLogMaxLength())
+                        val n = reader.read(buf)
+
+                        if (n <= 0) break
+
+                        index++
+                        assertEquals("$index$CONTENT", String(buf, 0, n))
+                    }
+                    reader.close()
+                }
+                readNum.set(index)
+            }
+        }
+        threads.forEach { it.join() }
+        readNums.forEach { assertEquals(LOG_NUM, it.get()) }
+    }
+
+    @Test
+    fun syncBatchWriteReadBatch() {
+        val (glog, files) = writeLogs("glog-test-read-batch")
+        val arena = java.nio.ByteBuffer.allocateDirect(64 * 1024)
+        val offsets = IntArray(256)
+        val lengths = IntArray(256)
+        var index = 0
+        var calls = 0
+        files.forEach { file ->
+            val reader = glog.openReader(file)
+            while (true) {
+                val n = reader.readBatch(arena, offsets, lengths)
+                calls++
+
+                if (n < 0) break
+
+                for (i in 0 until n) {
+                    val buf = ByteArray(lengths[i])
+                    arena.position(offsets[i])
+                    arena.get(buf)
+                    index++
+                    assertEquals("$index$CONTENT", String(buf))
+                }
+            }
+            reader.close()
+        }
+        assertEquals(LOG_NUM, index)
+        assertThat(calls, lessThan(LOG_NUM / 100))
+    }
+
+    @Test
+    fun syncWriteReadBackward() {
+        val (glog, files) = writeLogs("glog-test-read-backward", Glog.FileOrder.CreateTimeDescending) {
+            compressMode(Glog.CompressMode.Zlib)
+        }
+        val buf = ByteArray(Glog.getSingleLogMaxLength())
+        var index = LOG_NUM
+        files.forEach { file ->
+            val reader = glog.openReader(file)
+            while (true) {
+                val n = reader.readBackward(buf, 0, buf.size)
+
+                if (n < 0) break
+                if (n == 0) continue
+
+                assertEquals("$index$CONTENT", String(buf, 0, n))
+                index--
+            }
+            reader.close()
+        }
+        assertEquals(0, index)
+    }
+
     @Test
     fun asyncBatchWriteRead() {
         val appContext = InstrumentationRegistry.getInstrumentation().targetContext
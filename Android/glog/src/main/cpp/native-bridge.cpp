@@ -4,8 +4,10 @@
 #include <jni.h>
 #include "InternalLog.h"
 #include "android-log.h"
+#include <algorithm>
 #include <sys/stat.h>
 #include <thread>
+#include <vector>
 
 using namespace glog;
 using namespace std;
@@ -148,7 +150,7 @@ static jboolean jniWrite(JNIEnv *env,
         jbyte *data = env->GetByteArrayElements(bytes, nullptr);
         jboolean ret = false;
         if (data) {
-            ret = glPtr->write(GlogBuffer(data + offset, len));
+            ret = glPtr->write(data + offset, len);
             env->ReleaseByteArrayElements(bytes, data, JNI_ABORT);
         } else {
             InternalError("fail to alloc array, size:%d", len);
@@ -268,18 +270,54 @@ static jint jniRead(JNIEnv *env, jobject obj, jlong ptr, jbyteArray buf, jint of
 
     if (readerPtr) {
         if (len < SINGLE_LOG_CONTENT_MAX_LENGTH) {
-            InternalWarning(
-                "reader buffer:%d less than max log length:%d , may read ONLY part of log");
+            InternalWarning("reader buffer:%d less than max log length:%d, longer log will be skipped", len,
+                            SINGLE_LOG_CONTENT_MAX_LENGTH);
         }
         jbyte *jOutBuf = env->GetByteArrayElements(buf, nullptr);
-        GlogBuffer outBuffer(jOutBuf + offset, len);
-        result = readerPtr->read(outBuffer);
+        // chunks of long log are put together, buffer may be larger than one record
+        result = readerPtr->read(jOutBuf + offset, len);
         if (jOutBuf)
             env->ReleaseByteArrayElements(buf, jOutBuf, 0);
     }
     return result;
 }
 
+static jint jniReadBackward(JNIEnv *env, jobject obj, jlong ptr, jbyteArray buf, jint offset, jint len) {
+    auto *readerPtr = reinterpret_cast<GlogReader *>(ptr);
+    jint result = -1;
+
+    if (readerPtr) {
+        jbyte *jOutBuf = env->GetByteArrayElements(buf, nullptr);
+        result = readerPtr->readBackward(jOutBuf + offset, len);
+        if (jOutBuf)
+            env->ReleaseByteArrayElements(buf, jOutBuf, 0);
+    }
+    return result;
+}
+
+static jint jniReadBatch(JNIEnv *env, jobject obj, jlong ptr, jobject arena, jintArray offsets, jintArray lengths) {
+    auto *readerPtr = reinterpret_cast<GlogReader *>(ptr);
+    if (!readerPtr || !arena || !offsets || !lengths) {
+        return -1;
+    }
+    auto *arenaPtr = env->GetDirectBufferAddress(arena);
+    jlong capacity = env->GetDirectBufferCapacity(arena);
+    if (!arenaPtr || capacity <= 0) {
+        InternalError("arena is not a direct buffer");
+        return -1;
+    }
+    const jsize maxLogs = std::min(env->GetArrayLength(offsets), env->GetArrayLength(lengths));
+    vector<uint32_t> logOffsets(maxLogs), logLengths(maxLogs);
+    // decoded logs go straight to arena, one copy of offsets and lengths per batch
+    jint result = readerPtr->readBatch(arenaPtr, static_cast<size_t>(capacity), logOffsets.data(), logLengths.data(),
+                                       static_cast<size_t>(maxLogs));
+    if (result > 0) {
+        env->SetIntArrayRegion(offsets, 0, result, reinterpret_cast<const jint *>(logOffsets.data()));
+        env->SetIntArrayRegion(lengths, 0, result, reinterpret_cast<const jint *>(logLengths.data()));
+    }
+    return result;
+}
+
 static jint jniGetCurrentPosition(JNIEnv *env, jobject obj, jlong ptr) {
     auto *readerPtr = reinterpret_cast<GlogReader *>(ptr);
     if (readerPtr) {
@@ -373,6 +411,8 @@ static JNINativeMethod g_methods[] = {
     {"jniGetArchivesOfDate", "(JJ)[Ljava/lang/String;", (void *) glog_jni::jniGetArchivesOfDate},
     {"jniOpenReader", "(JLjava/lang/String;Ljava/lang/String;)J", (void *) glog_jni::jniOpenReader},
     {"jniRead", "(J[BII)I", (void *) glog_jni::jniRead},
+    {"jniReadBatch", "(JLjava/nio/ByteBuffer;[I[I)I", (void *) glog_jni::jniReadBatch},
+    {"jniReadBackward", "(J[BII)I", (void *) glog_jni::jniReadBackward},
     {"jniGetCurrentPosition", "(J)I", (void *) glog_jni::jniGetCurrentPosition},
     {"jniSeek", "(JI)Z", (void *) glog_jni::jniSeek},
     {"jniCloseReader", "(JJ)V", (void *) glog_jni::jniCloseReader},
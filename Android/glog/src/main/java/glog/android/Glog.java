@@ -8,6 +8,7 @@ import java.io.Closeable;
 import java.io.File;
 import java.io.FileNotFoundException;
 import java.io.IOException;
+import java.nio.ByteBuffer;
 import java.util.ArrayList;
 import java.util.concurrent.atomic.AtomicBoolean;
 
@@ -162,13 +163,18 @@ public final class Glog {
         return write(buf, 0, buf.length);
     }
 
+    /**
+     * write log of any length, log longer than getSingleLogMaxLength() is split into chunks, reader puts them together.
+     * hard limits, longer log is not written: without incrementalArchive the whole log must fit in one cache
+     * (about 7/8 of getCacheSize() with compression), in async mode it must fit in about 64MB.
+     */
     public boolean write(byte[] buf, int offset, int len) {
         if (buf == null) {
             throw new NullPointerException();
         } else if ((offset < 0) || (offset > buf.length) || (len < 0) ||
                 ((offset + len) > buf.length) || ((offset + len) < 0)) {
             throw new IndexOutOfBoundsException();
-        } else if (len == 0 || len > sSingleLogMaxLength) {
+        } else if (len == 0) {
             return false;
         }
         return jniWrite(nativePtr, buf, offset, len);
@@ -440,6 +446,41 @@ public final class Glog {
             return jniRead(nativePtr, buf, offset, len);
         }
 
+        /**
+         * read as many whole logs as fit in arena, log i is at offsets[i] of arena with lengths[i] bytes.
+         * log which doesn't fit in the rest of arena comes first in next call.
+         *
+         * @param arena direct buffer, logs are put from its beginning, position and limit are ignored
+         * @return number of logs read, < 0 if no more log or fail
+         */
+        public int readBatch(ByteBuffer arena, int[] offsets, int[] lengths) {
+            if (arena == null || offsets == null || lengths == null) {
+                throw new NullPointerException();
+            } else if (!arena.isDirect()) {
+                throw new IllegalArgumentException("arena must be a direct buffer");
+            } else if (offsets.length == 0 || lengths.length == 0) {
+                return -1;
+            }
+            return jniReadBatch(nativePtr, arena, offsets, lengths);
+        }
+
+        /**
+         * read logs from the newest to the oldest, independent of read and seek.
+         *
+         * @return length of log, 0 if broken bytes are skipped, < 0 if no more log or fail
+         */
+        public int readBackward(byte[] buf, int offset, int len) {
+            if (buf == null) {
+                throw new NullPointerException();
+            } else if ((offset < 0) || (offset > buf.length) || (len < 0) ||
+                    ((offset + len) > buf.length) || ((offset + len) < 0)) {
+                throw new IndexOutOfBoundsException();
+            } else if (len == 0) {
+                return -1;
+            }
+            return jniReadBackward(nativePtr, buf, offset, len);
+        }
+
         public int getCurrentPosition() {
             return jniGetCurrentPosition(nativePtr);
         }
@@ -504,6 +545,10 @@ public final class Glog {
 
     private static native int jniRead(long ptr, byte[] buf, int offset, int len);
 
+    private static native int jniReadBatch(long ptr, ByteBuffer arena, int[] offsets, int[] lengths);
+
+    private static native int jniReadBackward(long ptr, byte[] buf, int offset, int len);
+
     private static native int jniGetCurrentPosition(long ptr);
 
     private static native boolean jniSeek(long ptr, int offset);
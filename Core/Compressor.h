@@ -20,6 +20,9 @@ public:
 
     virtual void reset() = 0;
 
+    // upper bound of compressed size of next input
+    virtual size_t compressBound(size_t length) = 0;
+
     bool compress(const GlogBuffer &inBuffer, GlogBuffer &outBuffer) {
         InternalDebug("compress start, init:%d", m_init);
         if (!m_init)
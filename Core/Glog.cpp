@@ -3,6 +3,7 @@
 //
 
 #include "Glog.h"
+#include "GlogBuffer.h"
 #include "GlogFile.h"
 #include "GlogReader.h"
 #include "MessageQueue.h"
@@ -12,6 +13,7 @@
 #include "ZlibCompress.h"
 #include "utilities.h"
 #include <cerrno>
+#include <cstdlib>
 #include <fcntl.h>
 #include <regex>
 #include <unordered_map>
@@ -34,6 +36,8 @@ pthread_t *g_daemon;
 ThreadLock *g_daemonPollLock;
 ConditionVariable *g_daemonPollCond;
 atomic_bool g_daemonRunning = true;
+WriterExecutor *g_sharedWriter; // guide by g_instanceMutex, created by the first instance using it
+size_t g_sharedWriterNum = DEFAULT_SHARED_WRITER_NUM;
 
 void preparePartialTables() {
     const uint8_t len = format::SYNC_MARKER_LENGTH;
@@ -67,7 +71,8 @@ void *daemonAction(void *) {
     if (ret != 0) {
         InternalWarning("fail to set daemon thread name, %s", strerror(errno));
     }
-    bool initial = true;
+    const int64_t tickMillis = 2 * 60 * 1000;
+    int64_t nextTickMillis = cycleClockNow() / 1000 + 5 * 1000;
 
     while (true) {
         time_t now = wallTimeNow();
@@ -81,17 +86,34 @@ void *daemonAction(void *) {
             }
         });
 
+        // wake earlier for periodic msync of any instance
+        int64_t nowMillis = cycleClockNow() / 1000;
+        long timeoutMillis = static_cast<long>(std::min(std::max<int64_t>(nextTickMillis - nowMillis, 0), tickMillis));
+        applyOnAll([nowMillis, &timeoutMillis](Glog *ptr) -> void {
+            long millis = ptr->millisToPeriodicSync(nowMillis);
+            if (millis >= 0) {
+                timeoutMillis = std::min(timeoutMillis, millis);
+            }
+        });
+
         {
             SCOPED_LOCK(g_daemonPollLock);
 
             if (g_daemonRunning) {
-                g_daemonPollCond->awaitTimeout(*g_daemonPollLock, initial ? 5 * 1000 : 2 * 60 * 1000);
-                initial = false;
+                if (timeoutMillis > 0) {
+                    g_daemonPollCond->awaitTimeout(*g_daemonPollLock, timeoutMillis);
+                }
             } else {
                 InternalWarning("daemon quit.");
                 break;
             }
         }
+        nowMillis = cycleClockNow() / 1000;
+        applyOnAll([nowMillis](Glog *ptr) -> void { ptr->periodicSync(nowMillis); });
+        if (nowMillis < nextTickMillis) {
+            continue;
+        }
+        nextTickMillis = nowMillis + tickMillis;
         InternalDebug("daemon tick...");
 
         applyOnAll([](Glog *ptr) -> void {
@@ -132,8 +154,9 @@ void doInitialize() {
     prepareDaemonThread();
 }
 
-void Glog::initialize(InternalLogLevel logLevel) {
+void Glog::initialize(InternalLogLevel logLevel, size_t sharedWriterNum) {
     g_currentLogLevel = logLevel;
+    g_sharedWriterNum = sharedWriterNum;
     pthread_once(&onceControl, doInitialize);
 }
 
@@ -167,10 +190,23 @@ Glog *Glog::maybeCreateWithConfig(const GlogConfig &config) {
         }
     }
 
+    if (config.m_async && config.m_sharedWriter && !g_sharedWriter) {
+        g_sharedWriter = new WriterExecutor(g_sharedWriterNum);
+    }
     auto gPtr = new Glog(config.m_protoName, config.m_rootDirectory, config.m_async, config.m_expireSeconds,
                          config.m_totalArchiveSizeLimit, config.m_compressMode, config.m_encryptMode,
-                         config.m_incrementalArchive, config.m_serverPublicKey);
+                         config.m_incrementalArchive, config.m_serverPublicKey, config.m_asyncMemoryBudget,
+                         config.m_overflowPolicy, config.m_overflowBlockTimeoutMillis, config.m_overflowSampleRate,
+                         config.m_sharedWriter ? g_sharedWriter : nullptr, config.m_cacheShardNum,
+                         config.m_standbyCache, config.m_cacheHighWaterPercent, config.m_cacheSize,
+                         config.m_adaptiveCacheSize, config.m_maxCacheSize, config.m_prefaultCache,
+                         config.m_hugePageCache, config.m_syncPolicy, config.m_syncIntervalMillis);
     (*g_instanceMap)[config.m_protoName] = gPtr;
+    if (config.m_syncPolicy == SyncPolicy::Periodic && g_daemonRunning) {
+        // daemon may be waiting longer than the sync interval
+        SCOPED_LOCK(g_daemonPollLock);
+        g_daemonPollCond->signal();
+    }
     return gPtr;
 }
 
@@ -193,7 +229,22 @@ Glog::Glog(string protoName,
            format::GlogCompressMode compressMode,
            format::GlogEncryptMode encryptMode,
            bool incrementalArchive,
-           const string *serverPublicKey)
+           const string *serverPublicKey,
+           size_t asyncMemoryBudget,
+           OverflowPolicy overflowPolicy,
+           long overflowBlockTimeoutMillis,
+           uint32_t overflowSampleRate,
+           WriterExecutor *writerExecutor,
+           size_t cacheShardNum,
+           bool standbyCache,
+           uint32_t cacheHighWaterPercent,
+           size_t cacheSize,
+           bool adaptiveCacheSize,
+           size_t maxCacheSize,
+           bool prefaultCache,
+           bool hugePageCache,
+           SyncPolicy syncPolicy,
+           long syncIntervalMillis)
     : m_protoName(std::move(protoName))
     , m_async(async)
     , m_expireSeconds(expireSeconds)
@@ -204,18 +255,99 @@ Glog::Glog(string protoName,
     , m_syncWriteLock(new ThreadLock)
     , m_readingArchivesLock(new ThreadLock)
     , m_incrementalArchive(incrementalArchive)
-    , m_shouldTryFlushAcrossDay(false) {
-
-    m_cacheSize = calculateRoundCacheSize();
+    , m_shouldTryFlushAcrossDay(false)
+    , m_reserveThread()
+    , m_reserving(false)
+    , m_asyncMemoryBudget(asyncMemoryBudget)
+    , m_overflowPolicy(overflowPolicy)
+    , m_overflowBlockTimeoutMillis(overflowBlockTimeoutMillis)
+    , m_overflowSampleRate(overflowSampleRate > 0 ? overflowSampleRate : 1)
+    , m_pendingAsyncBytes(0)
+    , m_budgetWaiters(0)
+    , m_sampleCounter(0)
+    , m_droppedLogs(0)
+    , m_droppedBytes(0)
+    , m_budgetLock(new ThreadLock)
+    , m_budgetCondition(new ConditionVariable)
+    , m_shardSequence(0)
+    , m_standbyFile(nullptr)
+    , m_standbyCompressor(nullptr)
+    , m_archiveQueue(nullptr)
+    , m_standbyReady(false)
+    , m_archiveTicket(0)
+    , m_highWaterPercent(std::min(std::max(cacheHighWaterPercent, 1u), 100u))
+    , m_standbySwitches(0)
+    , m_standbyMisses(0)
+    , m_adaptiveCacheSize(adaptiveCacheSize)
+    , m_cacheFillBeginMillis(cycleClockNow() / 1000)
+    , m_cacheResizes(0)
+    , m_prefaultCache(prefaultCache)
+    , m_hugePageCache(hugePageCache)
+    , m_syncPolicy(syncPolicy)
+    , m_syncIntervalMillis(std::max(syncIntervalMillis, 1L))
+    , m_lastPeriodicSyncMillis(cycleClockNow() / 1000)
+    , m_msyncCalls(0)
+    , m_msyncBytes(0)
+    , m_skipChunks(false) {
+
+    // async mode has only one writer, nothing to shard
+    const size_t shardNum = async ? 0 : std::min(cacheShardNum, MAX_CACHE_SHARD_NUM);
+    const size_t shardSize = calculateRoundCacheSize();
+    // cache file takes logs of all shards in one merge
+    const size_t configSize = cacheSize > 0 ? std::min(std::max(cacheSize, MIN_CACHE_SIZE), MAX_CACHE_SIZE) : shardSize;
+    m_minCacheSize = std::max(roundUpToPageSize(configSize), shardNum > 1 ? shardSize * shardNum : 0);
+    m_maxCacheSize = std::max(roundUpToPageSize(std::min(maxCacheSize, MAX_CACHE_SIZE)), m_minCacheSize);
     m_rootDirectory = endsWithSplash(rootDirectory) ? rootDirectory : rootDirectory + "/";
     m_compressor = new ZlibCompressor();
     string cacheFilePath = makeCacheFilePath(m_protoName, m_rootDirectory);
-    m_cacheFile = new GlogFile(cacheFilePath, m_protoName, m_cacheSize, m_compressor, m_compressMode, m_encryptMode,
-                               serverPublicKey);
+    // never truncate logs left by last run with a larger cache, adaptive cache goes on from there
+    const size_t lastCacheSize = getFileSize(cacheFilePath);
+    m_cacheSize = m_adaptiveCacheSize ? std::min(std::max(lastCacheSize, m_minCacheSize), m_maxCacheSize)
+                                      : m_minCacheSize;
+    const MmapOptions mmapOptions{.m_prefault = m_prefaultCache, .m_hugePage = m_hugePageCache};
+    m_cacheFile = new GlogFile(cacheFilePath, m_protoName, std::max(m_cacheSize.load(), lastCacheSize), m_compressor,
+                               m_compressMode, m_encryptMode, serverPublicKey, nullptr, mmapOptions);
+    for (size_t i = 0; shardNum > 1 && i < shardNum; ++i) {
+        // logs of different shards are interleaved in archive, each must be decodable without the ones before
+        auto *compressor = new ZlibCompressor(true);
+        auto *file = new GlogFile(makeCacheShardFilePath(m_protoName, m_rootDirectory, i), m_protoName, shardSize,
+                                  compressor, m_compressMode, m_encryptMode, serverPublicKey, &m_shardSequence,
+                                  mmapOptions);
+        m_shards.push_back(CacheShard{.m_file = file, .m_compressor = compressor, .m_lock = new ThreadLock});
+    }
+    if (standbyCache) {
+        m_standbyCompressor = new ZlibCompressor();
+        const string standbyPath = makeStandbyCacheFilePath(m_protoName, m_rootDirectory);
+        m_standbyFile = new GlogFile(standbyPath, m_protoName, std::max(m_cacheSize.load(), getFileSize(standbyPath)),
+                                     m_standbyCompressor, m_compressMode, m_encryptMode, serverPublicKey, nullptr,
+                                     mmapOptions);
+        // dedicated thread, a shared writer may be the one waiting for the archive
+        m_archiveQueue = new MessageQueue(
+            ARCHIVE_QUEUE_CAPACITY, [](const struct iovec *, size_t) {},
+            [](const void *, size_t, format::GlogChunkType, size_t) {}, [](void *, size_t, size_t) {},
+            [this](MessageType, uint32_t, void *, bool) { archiveStandby(); });
+        if (!m_archiveQueue->isRunning()) {
+            delete m_archiveQueue;
+            delete m_standbyFile;
+            delete m_standbyCompressor;
+            m_archiveQueue = nullptr;
+            m_standbyFile = nullptr;
+            m_standbyCompressor = nullptr;
+        }
+    }
     // every message may take extra memory because a copy of log content made before enqueue
     // max extra memory = capacity * single log max size
     if (async) {
-        m_writeQueue = new MessageQueue(INT_MAX);
+        m_writeQueue = new MessageQueue(
+            MESSAGE_QUEUE_CAPACITY, [this](const struct iovec *logs, size_t num) { writeSyncBatch(logs, num); },
+            [this](const void *chunk, size_t length, format::GlogChunkType chunkType, size_t logLength) {
+                writeQueuedChunk(chunk, length, chunkType, logLength);
+            },
+            [this](void *block, size_t, size_t bytes) { releaseAsyncLog(block, bytes); },
+            [this](MessageType type, uint32_t flags, void *context, bool dropped) {
+                handleControlMessage(type, flags, context, dropped);
+            },
+            writerExecutor);
         if (!m_writeQueue->isRunning()) {
             m_writeQueue = nullptr;
             m_async = false;
@@ -223,12 +355,15 @@ Glog::Glog(string protoName,
     } else {
         m_writeQueue = nullptr;
     }
+    m_bufferPool = m_async ? new GlogBufferPool() : nullptr;
     makeArchiveNameRegex(m_incrementalArchive, m_protoName, m_archiveNameRegex);
     if (async) {
         if (m_writeQueue)
-            m_writeQueue->enqueue(Message([this]() { tryFlushAcrossDay(); }));
+            m_writeQueue->enqueueControl(MessageType::Flush, FLUSH_ON_START);
     } else {
         SCOPED_LOCK(m_syncWriteLock);
+        recoverStandby();
+        recoverShards();
         tryFlushAcrossDay();
     }
 }
@@ -236,10 +371,30 @@ Glog::Glog(string protoName,
 Glog::~Glog() {
     InternalDebug("glog dealloc");
     delete m_writeQueue;
-    delete m_cacheFile;
+    // finish archive in background before files go away
+    delete m_archiveQueue;
+    delete m_bufferPool;
+    // write back by sync policy, then file won't msync itself on delete
+    auto release = [this](GlogFile *file) {
+        if (file && file->isFileAlreadyOpen()) {
+            syncCacheFile(file);
+            file->closeFile();
+        }
+        delete file;
+    };
+    release(m_cacheFile);
     delete m_compressor;
+    release(m_standbyFile);
+    delete m_standbyCompressor;
+    for (auto &shard : m_shards) {
+        release(shard.m_file);
+        delete shard.m_compressor;
+        delete shard.m_lock;
+    }
     delete m_archiveLock;
     delete m_syncWriteLock;
+    delete m_budgetLock;
+    delete m_budgetCondition;
     delete m_readingArchivesLock;
     m_readingArchives.clear();
 }
@@ -256,8 +411,8 @@ void Glog::destroy(const string &protoName) {
 }
 void Glog::removeAll(bool removeReadingFiles, bool reloadCache) {
     if (m_async) {
-        m_writeQueue->enqueue(
-            Message([this, removeReadingFiles, reloadCache]() { doRemoveAll(removeReadingFiles, reloadCache); }));
+        m_writeQueue->enqueueControl(MessageType::RemoveAll, (removeReadingFiles ? REMOVE_READING_FILES : 0) |
+                                                                 (reloadCache ? REMOVE_RELOAD_CACHE : 0));
     } else {
         SCOPED_LOCK(m_syncWriteLock);
 
@@ -265,6 +420,43 @@ void Glog::removeAll(bool removeReadingFiles, bool reloadCache) {
     }
 }
 
+void Glog::handleControlMessage(MessageType type, uint32_t flags, void *context, bool dropped) {
+    if (context) {
+        auto *task = static_cast<AsyncFlushTask *>(context);
+        (*task)(dropped);
+        delete task;
+        return;
+    }
+    if (dropped) {
+        return;
+    }
+    // daemon thread syncs cache file with m_syncWriteLock held, take it as well before touching cache file
+    switch (type) {
+        case MessageType::Flush:
+            if (flags & FLUSH_ON_START) {
+                SCOPED_LOCK(m_syncWriteLock);
+
+                recoverStandby();
+                recoverShards();
+                tryFlushAcrossDay();
+            } else {
+                SCOPED_LOCK(m_archiveLock);
+                SCOPED_LOCK(m_syncWriteLock);
+
+                internalFlush();
+            }
+            break;
+        case MessageType::RemoveAll: {
+            SCOPED_LOCK(m_syncWriteLock);
+
+            doRemoveAll(flags & REMOVE_READING_FILES, flags & REMOVE_RELOAD_CACHE);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
 bool findLogFileOfDate(const string &rootDirectory, string &outFilename, const string &protoName, time_t epochSeconds) {
     ::tm tmTime{};
     //    ::gmtime_r(&nowStamp, &tmTime); // utc time
@@ -294,6 +486,7 @@ bool findLogFileOfDate(const string &rootDirectory, string &outFilename, const s
 }
 
 void Glog::doRemoveAll(bool removeReadingFiles, bool reloadCache) {
+    awaitStandby();
     list<FileStat> files;
     static size_t useless;
     collectArchives(files, FileOrder::None, useless);
@@ -322,7 +515,12 @@ void Glog::doRemoveAll(bool removeReadingFiles, bool reloadCache) {
         }
     }
 
-    if (reloadCache && m_cacheFile->getTotalLogNum() > 0) {
+    for (size_t i = 0; reloadCache && i < m_shards.size(); ++i) {
+        SCOPED_LOCK(m_shards[i].m_lock);
+
+        m_shards[i].m_file->clear();
+    }
+    if (reloadCache && !m_cacheFile->isEmpty()) {
         InternalDebug("removeAll, loadFromDisk cache");
         m_cacheFile->closeFile();
         removeFile(m_cacheFile->getPath());
@@ -357,6 +555,10 @@ void Glog::destroyAll() {
 
         delete g_instanceMap;
         g_instanceMap = nullptr;
+
+        // all queues are gone with instances
+        delete g_sharedWriter;
+        g_sharedWriter = nullptr;
     }
     delete g_instanceMutex;
 }
@@ -373,7 +575,7 @@ void Glog::unRegisterLogHandler() {
     g_logHandler = nullptr;
 }
 
-bool Glog::appendLogFile(uint8_t &maxRecursionDepth, time_t epochSeconds) {
+bool Glog::appendLogFile(GlogFile *file, uint8_t &maxRecursionDepth, time_t epochSeconds) {
     // 1. get log file of date
     // 2. if flush to today's log file and it's not exists, recreate cache
     // 3. check file valid, if invalid, remove it
@@ -407,7 +609,8 @@ bool Glog::appendLogFile(uint8_t &maxRecursionDepth, time_t epochSeconds) {
 
     size_t headerSize = 0;
     if (!recreate) {
-        HeaderMismatchReason reason = readHeader(fd, filepath, fileSize, m_protoName, &headerSize);
+        GlogByte_t versionCode = 0;
+        HeaderMismatchReason reason = readHeader(fd, filepath, fileSize, m_protoName, &headerSize, &versionCode);
 
         if (reason != HeaderMismatchReason::None) {
             int ret = ::remove(filepath.c_str());
@@ -418,11 +621,15 @@ bool Glog::appendLogFile(uint8_t &maxRecursionDepth, time_t epochSeconds) {
                           ::strerror(errno));
             if (--maxRecursionDepth <= 0) {
                 InternalError("appendLogFile() reach recursion upper limit");
-                m_cacheFile->closeFile();
+                file->closeFile();
                 closeFile(fd, filepath.c_str());
                 return false;
             }
-            return appendLogFile(maxRecursionDepth, epochSeconds);
+            return appendLogFile(file, maxRecursionDepth, epochSeconds);
+        }
+        // archive of today made by older version, appended logs may contain chunks
+        if (versionCode != static_cast<GlogByte_t>(format::GlogVersion::GlogChunkVersion)) {
+            upgradeVersionCode(fd, filepath, format::GlogVersion::GlogChunkVersion);
         }
     }
     size_t mmapOffset; // mmap starting at offset in the file, must be a multiple of the page size
@@ -432,10 +639,10 @@ bool Glog::appendLogFile(uint8_t &maxRecursionDepth, time_t epochSeconds) {
     if (recreate) {
         mmapOffset = 0;
         dstOffset = 0;
-        copySize = m_cacheFile->getPosition();
-        mmapSize = m_cacheFile->getPosition();
+        copySize = file->getPosition();
+        mmapSize = file->getPosition();
     } else {
-        copySize = m_cacheFile->getDataLength();
+        copySize = file->getDataLength();
         mmapOffset = fileSize / SYS_PAGE_SIZE * SYS_PAGE_SIZE;
         dstOffset = fileSize - mmapOffset;
         mmapSize = copySize + fileSize - mmapOffset;
@@ -450,7 +657,7 @@ bool Glog::appendLogFile(uint8_t &maxRecursionDepth, time_t epochSeconds) {
     if (::ftruncate(fd, mmapOffset + mmapSize) != 0) {
         InternalError("fail to truncate [%s] to size %zu, %s", filepath.c_str(), mmapOffset + mmapSize,
                       ::strerror(errno));
-        m_cacheFile->closeFile();
+        file->closeFile();
         closeFile(fd, filepath.c_str());
         return false;
     }
@@ -458,7 +665,7 @@ bool Glog::appendLogFile(uint8_t &maxRecursionDepth, time_t epochSeconds) {
     if (!GlogFile::zeroFillFile(fd, fileSize, copySize)) {
         InternalError("fail to zeroFile [%s] to size %zu, %s", filepath.c_str(), mmapOffset + mmapSize,
                       strerror(errno));
-        m_cacheFile->closeFile();
+        file->closeFile();
         closeFile(fd, filepath.c_str());
         return false;
     }
@@ -467,25 +674,31 @@ bool Glog::appendLogFile(uint8_t &maxRecursionDepth, time_t epochSeconds) {
     mmapPtr = ::mmap(mmapPtr, mmapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, mmapOffset);
     if (mmapPtr == MAP_FAILED) {
         InternalError("fail to mmap [%s], %s", filepath.c_str(), strerror(errno));
-        m_cacheFile->closeFile();
+        file->closeFile();
         closeFile(fd, filepath.c_str());
         return false;
     }
 
-    auto *src = (uint8_t *) m_cacheFile->getMemoryPtr();
+    auto *src = (uint8_t *) file->getMemoryPtr();
 
     if (src == nullptr || src == MAP_FAILED) {
         InternalError("fail to get cache file [%s] mmap ptr", filepath.c_str());
-        m_cacheFile->closeFile();
+        file->closeFile();
         closeFile(fd, filepath.c_str());
         return false;
     }
     memcpy((uint8_t *) mmapPtr + dstOffset, src + headerSize, copySize);
 
     if (mmapPtr && mmapPtr != MAP_FAILED) {
-        if (::msync(mmapPtr, mmapSize, MS_SYNC) != 0) {
-            InternalError("fail to msync [%s] offset:%zu size:%zu %s", filepath.c_str(), mmapOffset, mmapSize,
-                          strerror(errno));
+        // mapping covers only the appended logs, dirty range is all of it
+        if (m_syncPolicy != SyncPolicy::Never) {
+            if (::msync(mmapPtr, mmapSize, m_syncPolicy == SyncPolicy::Periodic ? MS_ASYNC : MS_SYNC) != 0) {
+                InternalError("fail to msync [%s] offset:%zu size:%zu %s", filepath.c_str(), mmapOffset, mmapSize,
+                              strerror(errno));
+            } else {
+                m_msyncCalls++;
+                m_msyncBytes += mmapSize;
+            }
         }
 
         if (::munmap(mmapPtr, mmapSize) != 0) {
@@ -497,31 +710,83 @@ bool Glog::appendLogFile(uint8_t &maxRecursionDepth, time_t epochSeconds) {
     if (::ftruncate(fd, fileSize + copySize) != 0) {
         InternalError("fail to truncate [%s] to size %zu, %s", filepath.c_str(), fileSize + copySize,
                       ::strerror(errno));
-        m_cacheFile->closeFile();
+        file->closeFile();
         closeFile(fd, filepath.c_str());
         return false;
     }
 
     //    // reset file content to '0' except header
-    //    memset((uint8_t *) m_cacheFile->getMemoryPtr() + m_cacheFile->getHeaderSize(), 0,
-    //           m_cacheFile->getPosition() - m_cacheFile->getHeaderSize());
-    //    m_cacheFile->resetInternalState();
+    //    memset((uint8_t *) file->getMemoryPtr() + file->getHeaderSize(), 0,
+    //           file->getPosition() - file->getHeaderSize());
+    //    file->resetInternalState();
 
-    m_cacheFile->closeFile();
+    file->closeFile();
     closeFile(fd, filepath.c_str());
-    if (::remove(m_cacheFile->getPath().c_str()) < 0) {
-        InternalError("fail to remove file [%s] %s", m_cacheFile->getPath().c_str(), ::strerror(errno));
-        m_cacheFile->closeFile();
+    if (::remove(file->getPath().c_str()) < 0) {
+        InternalError("fail to remove file [%s] %s", file->getPath().c_str(), ::strerror(errno));
+        file->closeFile();
         closeFile(fd, filepath.c_str());
         return false;
     } else {
-        InternalDebug("remove file [%s]", m_cacheFile->getPath().c_str());
+        InternalDebug("remove file [%s]", file->getPath().c_str());
     }
     uint8_t depth = MAX_RECURSION_DEPTH;
-    return m_cacheFile->loadFromDisk(depth, m_cacheSize);
+    return file->loadFromDisk(depth, m_cacheSize);
+}
+
+void Glog::syncCacheFile(GlogFile *file) {
+    size_t bytes = 0;
+    switch (m_syncPolicy) {
+        case SyncPolicy::Full:
+            file->msync(SyncFlag::Glog_SYNC, false, &bytes);
+            break;
+        case SyncPolicy::DirtyRange:
+            file->msync(SyncFlag::Glog_SYNC, true, &bytes);
+            break;
+        case SyncPolicy::Periodic:
+            file->msync(SyncFlag::Glog_ASYNC, true, &bytes);
+            break;
+        case SyncPolicy::Never:
+            break;
+    }
+    if (bytes > 0) {
+        m_msyncCalls++;
+        m_msyncBytes += bytes;
+    }
+}
+
+long Glog::millisToPeriodicSync(int64_t nowMillis) const {
+    if (m_syncPolicy != SyncPolicy::Periodic) {
+        return -1;
+    }
+    return static_cast<long>(std::max<int64_t>(m_lastPeriodicSyncMillis + m_syncIntervalMillis - nowMillis, 0));
+}
+
+void Glog::periodicSync(int64_t nowMillis) {
+    if (millisToPeriodicSync(nowMillis) != 0) {
+        return;
+    }
+    m_lastPeriodicSyncMillis = nowMillis;
+    {
+        SCOPED_LOCK(m_syncWriteLock);
+        syncCacheFile(m_cacheFile);
+    }
+    for (auto &shard : m_shards) {
+        SCOPED_LOCK(shard.m_lock);
+        syncCacheFile(shard.m_file);
+    }
 }
 
 bool Glog::internalFlush() {
+    if (!mergeShards()) {
+        InternalWarning("fail to merge some logs of cache shards");
+    }
+    awaitStandby();
+    adaptCacheSize(false);
+    return flushCacheFile(m_cacheFile);
+}
+
+bool Glog::flushCacheFile(GlogFile *file) {
     InternalDebug("==> maybe start flush ==>");
 
     // 0. msync
@@ -537,28 +802,33 @@ bool Glog::internalFlush() {
     // if is incremental flush
     // 1. append to today log file
 
-    if (!m_cacheFile->getTotalLogNum()) { // no log in cache
+    if (file->isEmpty()) { // no log in cache
         return false;
     }
     InternalDebug("==> start flush ==>");
 
-    m_cacheFile->msync();
+    syncCacheFile(file);
 
     if (m_incrementalArchive) {
         uint8_t maxDepth = MAX_RECURSION_DEPTH;
         WallTime_t now = wallTimeNow();
         auto nowStamp = static_cast<time_t>(now);
-        return appendLogFile(maxDepth, nowStamp); // flush to today's log file
+        return appendLogFile(file, maxDepth, nowStamp); // flush to today's log file
     }
 
-    size_t actualSize = m_cacheFile->getPosition();
-    if (::ftruncate(m_cacheFile->getFd(), actualSize) != 0) {
-        InternalError("fail to truncate [%s] to size %zu, %s", m_cacheFile->getPath().c_str(), actualSize,
+    size_t actualSize = file->getPosition();
+    if (::ftruncate(file->getFd(), actualSize) != 0) {
+        InternalError("fail to truncate [%s] to size %zu, %s", file->getPath().c_str(), actualSize,
                       ::strerror(errno));
         return false;
     }
-    m_cacheFile->closeFile();
+    file->closeFile();
     string filePath = makeArchiveFilePath(m_protoName, m_rootDirectory);
+    // small cache may fill up within a millisecond, take the next name instead of overwriting last archive
+    for (int retry = 0; retry < MAX_ARCHIVE_NAME_RETRY && isFileExists(filePath); ++retry) {
+        ::usleep(1000);
+        filePath = makeArchiveFilePath(m_protoName, m_rootDirectory);
+    }
     InternalDebug("archive file path:%s", filePath.c_str());
 
     if (isFileExists(filePath)) {
@@ -568,13 +838,13 @@ bool Glog::internalFlush() {
         }
     }
 
-    if (::rename(m_cacheFile->getPath().c_str(), filePath.c_str()) < 0) {
-        InternalError("fail to rename file [%s] to %s, %s", m_cacheFile->getPath().c_str(), filePath.c_str(),
+    if (::rename(file->getPath().c_str(), filePath.c_str()) < 0) {
+        InternalError("fail to rename file [%s] to %s, %s", file->getPath().c_str(), filePath.c_str(),
                       strerror(errno));
         return false;
     }
     uint8_t depth = MAX_RECURSION_DEPTH;
-    bool loaded = m_cacheFile->loadFromDisk(depth, m_cacheSize);
+    bool loaded = file->loadFromDisk(depth, m_cacheSize);
     if (!loaded) {
         return false;
     }
@@ -582,11 +852,305 @@ bool Glog::internalFlush() {
     return true;
 }
 
-string Glog::getArchiveSnapshot(vector<string> &archives, const ArchiveCondition &condition, FileOrder order) {
-    bool flush = condition.m_flush && (condition.m_minLogNum <= m_cacheFile->getTotalLogNum() ||
-                                       condition.m_totalLogSize <= m_cacheFile->getTotalLogSize());
-    InternalDebug("get archive snapshot, log in cache num:%d, size:%d, need flush:%d", m_cacheFile->getTotalLogNum(),
-                  m_cacheFile->getTotalLogSize(), flush);
+bool Glog::switchCacheFile() {
+    if (!m_standbyFile) {
+        adaptCacheSize(true);
+        return flushCacheFile(m_cacheFile);
+    }
+    if (m_cacheFile->isEmpty()) { // no log in cache
+        return false;
+    }
+    adaptCacheSize(true);
+    if (!m_standbyReady) {
+        m_standbyMisses++;
+        awaitStandby();
+    }
+    if (!m_standbyReady) {
+        InternalWarning("standby cache unavailable, archive cache in current thread");
+        return flushCacheFile(m_cacheFile);
+    }
+    // logs go with the content, cache goes on with the empty file
+    m_cacheFile->swapContent(*m_standbyFile);
+    std::swap(m_compressor, m_standbyCompressor);
+    m_standbyReady = false;
+    m_standbySwitches++;
+
+    uint64_t ticket = m_archiveQueue->enqueueControl(MessageType::Flush);
+    if (ticket == 0) {
+        InternalWarning("archive queue quit, archive standby in current thread");
+        archiveStandby();
+    } else {
+        m_archiveTicket = ticket;
+    }
+    return true;
+}
+
+void Glog::maybeSwitchCacheFile() {
+    if (m_standbyFile && m_standbyReady &&
+        m_cacheFile->getPosition() >= m_cacheFile->getSize() / 100 * m_highWaterPercent) {
+        switchCacheFile();
+    }
+}
+
+void Glog::adaptCacheSize(bool full) {
+    if (!m_adaptiveCacheSize) {
+        return;
+    }
+    const int64_t nowMillis = cycleClockNow() / 1000;
+    const int64_t fillMillis = nowMillis - m_cacheFillBeginMillis;
+    const size_t used = m_cacheFile->getPosition();
+    const size_t size = m_cacheFile->getSize();
+    m_cacheFillBeginMillis = nowMillis;
+
+    size_t newSize = m_cacheSize;
+    if (full && fillMillis < CACHE_GROW_FILL_MILLIS) {
+        newSize = std::min(size * 2, m_maxCacheSize);
+    } else if (!full && used < size / 4) {
+        newSize = std::max(roundUpToPageSize(size / 2), m_minCacheSize);
+    }
+    if (newSize != m_cacheSize) {
+        InternalInfo("resize cache of [%s] from %zu to %zu, filled %zu in %lld ms", m_protoName.c_str(),
+                     m_cacheSize.load(), newSize, used, (long long) fillMillis);
+        m_cacheSize = newSize;
+        m_cacheResizes++;
+    }
+}
+
+void Glog::awaitStandby() {
+    if (m_standbyFile && !m_standbyReady) {
+        m_archiveQueue->awaitHandled(m_archiveTicket, -1);
+    }
+}
+
+void Glog::archiveStandby() {
+    if (!m_standbyFile->isEmpty() && !flushCacheFile(m_standbyFile)) {
+        InternalError("fail to archive standby cache [%s]", m_standbyFile->getPath().c_str());
+    }
+    if (!m_standbyFile->isFileAlreadyOpen()) {
+        uint8_t depth = MAX_RECURSION_DEPTH;
+        m_standbyFile->loadFromDisk(depth, m_cacheSize);
+    }
+    m_standbyReady = m_standbyFile->isFileAlreadyOpen() && m_standbyFile->isEmpty();
+}
+
+void Glog::recoverStandby() {
+    if (!m_standbyFile) {
+        // standby cache turned off since last run, archive what it left once
+        const string path = makeStandbyCacheFilePath(m_protoName, m_rootDirectory);
+        if (!isFileExists(path)) {
+            return;
+        }
+        GlogFile file(path, m_protoName, getFileSize(path), nullptr, format::GlogCompressMode::None,
+                      format::GlogEncryptMode::None, nullptr);
+        if (!file.isEmpty()) {
+            InternalInfo("archive logs left in standby cache [%s]", path.c_str());
+            flushCacheFile(&file);
+        }
+        file.closeFile();
+        if (::remove(path.c_str()) < 0) {
+            InternalError("fail to remove file [%s] %s", path.c_str(), ::strerror(errno));
+        }
+        return;
+    }
+    if (!m_standbyFile->isEmpty()) {
+        // quit while archiving. cache and standby swap content on every switch, the one written last is newer
+        int64_t cacheModifyMs = 0;
+        int64_t standbyModifyMs = 0;
+        getFileModifyTime(m_standbyFile->getPath(), standbyModifyMs);
+        if (!m_cacheFile->isEmpty() && getFileModifyTime(m_cacheFile->getPath(), cacheModifyMs) &&
+            cacheModifyMs < standbyModifyMs) {
+            m_cacheFile->swapContent(*m_standbyFile);
+            std::swap(m_compressor, m_standbyCompressor);
+            standbyModifyMs = cacheModifyMs;
+        }
+        InternalInfo("archive logs left in standby cache [%s]", m_standbyFile->getPath().c_str());
+        if (m_incrementalArchive && standbyModifyMs > 0) {
+            // to log file of the day they are written
+            syncCacheFile(m_standbyFile);
+            uint8_t maxDepth = MAX_RECURSION_DEPTH;
+            appendLogFile(m_standbyFile, maxDepth, static_cast<time_t>(standbyModifyMs * 0.001));
+        } else {
+            flushCacheFile(m_standbyFile);
+        }
+    }
+    archiveStandby();
+}
+
+bool Glog::mergeShards(const std::function<void()> &whileLocked) {
+    if (m_shards.empty()) {
+        return true;
+    }
+    vector<GlogFile *> files;
+    files.reserve(m_shards.size());
+    // always lock in index order
+    for (auto &shard : m_shards) {
+        shard.m_lock->lock();
+        files.push_back(shard.m_file);
+    }
+    bool ret = mergeSequencedFiles(files);
+    if (whileLocked) {
+        whileLocked();
+    }
+    for (auto itr = m_shards.rbegin(); itr != m_shards.rend(); ++itr) {
+        itr->m_lock->unlock();
+    }
+    return ret;
+}
+
+bool Glog::mergeSequencedFiles(const vector<GlogFile *> &files) {
+    const size_t fileNum = files.size();
+    vector<size_t> offsets(fileNum);
+    vector<SequencedRecord> heads(fileNum);
+    vector<bool> hasHead(fileNum);
+    for (size_t i = 0; i < fileNum; ++i) {
+        offsets[i] = files[i]->getHeaderSize();
+        hasHead[i] = files[i]->isFileAlreadyOpen() && files[i]->nextSequencedRecord(offsets[i], heads[i]);
+    }
+
+    bool ret = true;
+    while (true) {
+        // few shards, linear scan is cheaper than a heap
+        size_t picked = fileNum;
+        for (size_t i = 0; i < fileNum; ++i) {
+            if (hasHead[i] && (picked == fileNum || heads[i].m_sequence < heads[picked].m_sequence)) {
+                picked = i;
+            }
+        }
+        if (picked == fileNum) {
+            break;
+        }
+        const SequencedRecord &record = heads[picked];
+        if (!m_cacheFile->appendSequencedRecord(record)) {
+            // cache file is full, archive it and go on
+            if (!switchCacheFile() || !m_cacheFile->appendSequencedRecord(record)) {
+                InternalError("fail to merge log of [%s], sequence:%llu", files[picked]->getPath().c_str(),
+                              (unsigned long long) record.m_sequence);
+                ret = false;
+            }
+        }
+        hasHead[picked] = files[picked]->nextSequencedRecord(offsets[picked], heads[picked]);
+    }
+
+    for (auto file : files) {
+        file->clear();
+    }
+    // next log of cache file must not refer to the content before merged ones
+    m_compressor->reset();
+    return ret;
+}
+
+void Glog::recoverShards() {
+    // marker is kept while shards are configured, so shards left after turning them off are still found
+    const string markerPath = makeCacheShardMarkerPath(m_protoName, m_rootDirectory);
+    const bool marked = isFileExists(markerPath);
+    if (m_shards.empty() && !marked) {
+        return;
+    }
+    if (!m_shards.empty() && !marked) {
+        int fd = ::open(markerPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRWXU);
+        if (fd < 0) {
+            InternalError("fail to create [%s], %s", markerPath.c_str(), strerror(errno));
+        } else {
+            closeFile(fd, markerPath.c_str());
+        }
+    }
+
+    // [protoName].N.glogmmap
+    const string prefix = m_protoName + ".";
+    const string suffix = CACHE_FILE_SUFFIX;
+    vector<string> filenames;
+    listFilesInDir(m_rootDirectory, filenames);
+
+    vector<GlogFile *> files;
+    vector<GlogFile *> orphans;
+    for (auto &shard : m_shards) {
+        files.push_back(shard.m_file);
+    }
+    for (const auto &filename : filenames) {
+        if (filename.size() <= prefix.size() + suffix.size() || filename.compare(0, prefix.size(), prefix) != 0 ||
+            filename.compare(filename.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            continue;
+        }
+        const string index = filename.substr(prefix.size(), filename.size() - prefix.size() - suffix.size());
+        if (!std::all_of(index.begin(), index.end(), ::isdigit)) {
+            continue;
+        }
+        errno = 0;
+        const unsigned long shardIndex = ::strtoul(index.c_str(), nullptr, 10);
+        const string path = m_rootDirectory + filename;
+        // exactly the name a shard gets, e.g. not 01
+        if (errno == ERANGE || shardIndex >= MAX_CACHE_SHARD_NUM || shardIndex < m_shards.size() ||
+            path != makeCacheShardFilePath(m_protoName, m_rootDirectory, shardIndex)) {
+            continue;
+        }
+        // may be cache of another proto named like [protoName].N, leave it alone
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            InternalError("fail to open [%s], %s", path.c_str(), strerror(errno));
+            continue;
+        }
+        HeaderMismatchReason reason = readHeader(fd, path, getFileSize(path), m_protoName, nullptr, nullptr,
+                                                 format::GlogVersion::GlogSequenceVersion);
+        closeFile(fd, path.c_str());
+        if (reason != HeaderMismatchReason::None) {
+            InternalWarning("skip [%s], not a cache shard of [%s], reason:%d", path.c_str(), m_protoName.c_str(),
+                            reason);
+            continue;
+        }
+        // shard num reduced since last run, keep its size and read it once
+        InternalInfo("merge orphan cache shard [%s]", path.c_str());
+        auto *file = new GlogFile(path, m_protoName, getFileSize(path), nullptr, format::GlogCompressMode::None,
+                                  format::GlogEncryptMode::None, nullptr, &m_shardSequence);
+        files.push_back(file);
+        orphans.push_back(file);
+    }
+
+    size_t logNum = 0;
+    for (auto file : files) {
+        logNum += file->getTotalLogNum();
+    }
+    if (logNum > 0 && !mergeSequencedFiles(files)) {
+        InternalWarning("fail to merge some logs of cache shards");
+    }
+    for (auto file : orphans) {
+        const string path = file->getPath();
+        delete file;
+        if (::remove(path.c_str()) < 0) {
+            InternalError("fail to remove file [%s] %s", path.c_str(), ::strerror(errno));
+        }
+    }
+    if (m_shards.empty() && ::remove(markerPath.c_str()) < 0) {
+        InternalError("fail to remove file [%s] %s", markerPath.c_str(), ::strerror(errno));
+    }
+}
+
+size_t Glog::cachedLogNum() const {
+    size_t num = m_cacheFile->getTotalLogNum();
+    if (m_standbyFile && !m_standbyReady) {
+        num += m_standbyFile->getTotalLogNum();
+    }
+    for (auto &shard : m_shards) {
+        num += shard.m_file->getTotalLogNum();
+    }
+    return num;
+}
+
+size_t Glog::cachedLogSize() const {
+    size_t size = m_cacheFile->getTotalLogSize();
+    if (m_standbyFile && !m_standbyReady) {
+        size += m_standbyFile->getTotalLogSize();
+    }
+    for (auto &shard : m_shards) {
+        size += shard.m_file->getTotalLogSize();
+    }
+    return size;
+}
+
+bool Glog::checkSnapshotCondition(const ArchiveCondition &condition, FileOrder order, string &outMessage) {
+    const size_t cachedNum = cachedLogNum();
+    const size_t cachedSize = cachedLogSize();
+    bool flush = condition.m_flush && (condition.m_minLogNum <= cachedNum || condition.m_totalLogSize <= cachedSize);
+    InternalDebug("get archive snapshot, log in cache num:%d, size:%d, need flush:%d", cachedNum, cachedSize, flush);
 
     const size_t bufLen = 1024;
     char buf[bufLen];
@@ -596,53 +1160,52 @@ string Glog::getArchiveSnapshot(vector<string> &archives, const ArchiveCondition
              condition.m_flush ? "true" : "false", condition.m_totalLogSize, condition.m_minLogNum,
              order == FileOrder::CreateTimeAscending ? "Ascending" : "Descending");
 
-    string message{buf};
+    outMessage = buf;
 
     if (condition.m_flush && !flush) {
-        message += ", skip flush";
-        if (condition.m_minLogNum > m_cacheFile->getTotalLogNum()) {
-            int num = static_cast<int>(m_cacheFile->getTotalLogNum());
-            message += ", insufficient log num:" + std::to_string(num);
+        outMessage += ", skip flush";
+        if (condition.m_minLogNum > cachedNum) {
+            int num = static_cast<int>(cachedNum);
+            outMessage += ", insufficient log num:" + std::to_string(num);
         }
 
-        if (condition.m_totalLogSize > m_cacheFile->getTotalLogSize()) {
-            int size = static_cast<int>(m_cacheFile->getTotalLogSize());
-            message += ", insufficient log size:" + std::to_string(size);
+        if (condition.m_totalLogSize > cachedSize) {
+            int size = static_cast<int>(cachedSize);
+            outMessage += ", insufficient log size:" + std::to_string(size);
         }
     }
+    return flush;
+}
 
-    auto collect = [this, order](vector<string> &archives) {
-        list<FileStat> stats;
-        static size_t useless;
-        collectArchives(stats, order, useless);
-        archives.resize(stats.size());
-        std::transform(stats.begin(), stats.end(), archives.begin(), [](const FileStat &st) { return st.m_path; });
-    };
+void Glog::collectArchivePaths(vector<string> &archives, FileOrder order) {
+    list<FileStat> stats;
+    size_t useless;
+    collectArchives(stats, order, useless);
+    archives.resize(stats.size());
+    std::transform(stats.begin(), stats.end(), archives.begin(), [](const FileStat &st) { return st.m_path; });
+}
+
+string Glog::getArchiveSnapshot(vector<string> &archives, const ArchiveCondition &condition, FileOrder order) {
+    string message;
+    bool flush = checkSnapshotCondition(condition, order, message);
 
     if (flush) {
         if (m_async) {
-            auto flushFinishCond = std::make_shared<ConditionVariable>();
-            auto flushFinished = std::make_shared<bool>(false);
-
-            m_writeQueue->enqueue(Message([this, flushFinishCond, flushFinished]() {
-                SCOPED_LOCK(m_archiveLock);
-
-                internalFlush();
-                *flushFinished = true;
-                flushFinishCond->signal();
-            }));
+            uint64_t ticket = m_writeQueue->enqueueControl(MessageType::Flush);
+            if (!m_writeQueue->awaitHandled(ticket, FLUSH_AWAIT_TIMEOUT_MILLIS)) {
+                // archives are incomplete until worker catches up, report nothing rather than a partial list
+                archives.clear();
+                message += ", flush timeout after [" + std::to_string(FLUSH_AWAIT_TIMEOUT_MILLIS) +
+                           "] ms, snapshot abandoned";
+                InternalWarning("flush timeout after [%ld] ms, snapshot abandoned", FLUSH_AWAIT_TIMEOUT_MILLIS);
+                return message;
+            }
             {
+                // flush in worker holds it too
                 SCOPED_LOCK(m_archiveLock);
 
-                if (!*flushFinished) {
-                    bool timeout = !flushFinishCond->awaitTimeout(*m_archiveLock, FLUSH_AWAIT_TIMEOUT_MILLIS);
-                    if (timeout) {
-                        message += ", flush timeout after [" + std::to_string(FLUSH_AWAIT_TIMEOUT_MILLIS) + "] ms";
-                        InternalWarning("flush timeout after [%ld] ms", FLUSH_AWAIT_TIMEOUT_MILLIS);
-                    }
-                }
                 START_WATCH("glog watch collect archives");
-                collect(archives);
+                collectArchivePaths(archives, order);
                 LAP("collect");
                 END_WATCH();
             }
@@ -651,18 +1214,51 @@ string Glog::getArchiveSnapshot(vector<string> &archives, const ArchiveCondition
 
             bool ret = internalFlush();
             InternalDebug("flush in current thread, result:%d", ret);
-            collect(archives);
+            collectArchivePaths(archives, order);
         }
     } else {
         SCOPED_LOCK(m_syncWriteLock);
 
-        collect(archives);
+        collectArchivePaths(archives, order);
     }
     InternalDebug("get archive snapshot, file num:%d", archives.size());
     message += ", snapshot files num:" + std::to_string(static_cast<int>(archives.size()));
     return message;
 }
 
+void Glog::getArchiveSnapshotAsync(const ArchiveCondition &condition, FileOrder order, ArchiveSnapshotCallback callback) {
+    if (!m_async) {
+        vector<string> archives;
+        string message = getArchiveSnapshot(archives, condition, order);
+        if (callback) {
+            callback(archives, message);
+        }
+        return;
+    }
+    enqueueAsyncFlushTask(new AsyncFlushTask([this, condition, order, callback](bool dropped) {
+        vector<string> archives;
+        string message;
+        if (dropped) {
+            message = "get archive snapshot dropped, glog destroyed before snapshot";
+        } else {
+            // checked in worker so logs enqueued before are counted
+            bool flush = checkSnapshotCondition(condition, order, message);
+            SCOPED_LOCK(m_archiveLock);
+            SCOPED_LOCK(m_syncWriteLock);
+
+            if (flush) {
+                bool ret = internalFlush();
+                InternalDebug("flush in worker thread, result:%d", ret);
+            }
+            collectArchivePaths(archives, order);
+            message += ", snapshot files num:" + std::to_string(static_cast<int>(archives.size()));
+        }
+        if (callback) {
+            callback(archives, message);
+        }
+    }));
+}
+
 void Glog::collectArchives(list<FileStat> &archives, FileOrder order, size_t &totalSize) {
     vector<string> filenames;
     bool ret = listFilesInDir(m_rootDirectory, filenames);
@@ -812,19 +1408,29 @@ void Glog::cleanupSafely() {
 }
 
 GlogReader *Glog::openReader(const string &archiveFile, const string *serverPrivateKey) {
+    std::shared_ptr<GlogArchive> archive;
     {
         SCOPED_LOCK(m_readingArchivesLock);
 
-        m_readingArchives.emplace(archiveFile);
+        ReadingArchive &reading = m_readingArchives[archiveFile];
+        // appended since last open, new reader sees what's appended
+        if (!reading.m_archive || !reading.m_archive->isUpToDate()) {
+            reading.m_archive = GlogArchive::open(archiveFile, m_protoName);
+        }
+        reading.m_readers++;
+        archive = reading.m_archive;
     }
-    return new GlogReader(archiveFile, m_protoName, serverPrivateKey);
+    return new GlogReader(archiveFile, std::move(archive), serverPrivateKey);
 }
 
 void Glog::closeReader(GlogReader *reader) {
     {
         SCOPED_LOCK(m_readingArchivesLock);
 
-        m_readingArchives.erase(reader->m_file);
+        auto itr = m_readingArchives.find(reader->m_file);
+        if (itr != m_readingArchives.end() && --itr->second.m_readers == 0) {
+            m_readingArchives.erase(itr);
+        }
     }
 
     delete reader;
@@ -851,27 +1457,28 @@ void Glog::removeArchiveFile(const string &file, bool removeReadingFile) {
     }
 }
 
+GlogStatistics Glog::getStatistics() const {
+    GlogStatistics statistics{};
+    if (m_bufferPool) {
+        statistics.m_bufferPoolHits = m_bufferPool->getHits();
+        statistics.m_bufferPoolMisses = m_bufferPool->getMisses();
+    }
+    statistics.m_droppedLogs = m_droppedLogs;
+    statistics.m_droppedBytes = m_droppedBytes;
+    statistics.m_standbySwitches = m_standbySwitches;
+    statistics.m_standbyMisses = m_standbyMisses;
+    statistics.m_cacheSize = m_cacheSize;
+    statistics.m_cacheResizes = m_cacheResizes;
+    statistics.m_msyncCalls = m_msyncCalls;
+    statistics.m_msyncBytes = m_msyncBytes;
+    return statistics;
+}
+
 void Glog::flush() {
     if (m_async) {
-        auto flushFinishCond = std::make_shared<ConditionVariable>();
-        auto flushFinished = std::make_shared<bool>(false);
-
-        m_writeQueue->enqueue(Message([this, flushFinishCond, flushFinished]() {
-            SCOPED_LOCK(m_archiveLock);
-
-            internalFlush();
-            *flushFinished = true;
-            flushFinishCond->signal();
-        }));
-        {
-            SCOPED_LOCK(m_archiveLock);
-
-            if (!*flushFinished) {
-                bool timeout = !flushFinishCond->awaitTimeout(*m_archiveLock, FLUSH_AWAIT_TIMEOUT_MILLIS);
-                if (timeout) {
-                    InternalWarning("flush timeout after [%ld] ms", FLUSH_AWAIT_TIMEOUT_MILLIS);
-                }
-            }
+        uint64_t ticket = m_writeQueue->enqueueControl(MessageType::Flush);
+        if (!m_writeQueue->awaitHandled(ticket, FLUSH_AWAIT_TIMEOUT_MILLIS)) {
+            InternalWarning("flush timeout after [%ld] ms", FLUSH_AWAIT_TIMEOUT_MILLIS);
         }
     } else {
         SCOPED_LOCK(m_syncWriteLock);
@@ -881,6 +1488,37 @@ void Glog::flush() {
     }
 }
 
+void Glog::flushAsync(FlushCallback callback) {
+    if (!m_async) {
+        flush();
+        if (callback) {
+            callback(true);
+        }
+        return;
+    }
+    enqueueAsyncFlushTask(new AsyncFlushTask([this, callback](bool dropped) {
+        if (!dropped) {
+            SCOPED_LOCK(m_archiveLock);
+            SCOPED_LOCK(m_syncWriteLock);
+
+            bool ret = internalFlush();
+            InternalDebug("flush in worker thread, result:%d", ret);
+        }
+        if (callback) {
+            callback(!dropped);
+        }
+    }));
+}
+
+void Glog::enqueueAsyncFlushTask(AsyncFlushTask *task) {
+    // once enqueued, the queue hands task back to handleControlMessage exactly once
+    if (m_writeQueue->enqueueControl(MessageType::Flush, 0, task) == 0) {
+        InternalWarning("mq quit, drop async flush");
+        (*task)(true);
+        delete task;
+    }
+}
+
 // directory/[protoName].glogmmap
 string makeCacheFilePath(const string &protoName, const string &directory) {
     const size_t fixedLength = protoName.size() + directory.size() + strlen(CACHE_FILE_SUFFIX) + 16;
@@ -890,6 +1528,21 @@ string makeCacheFilePath(const string &protoName, const string &directory) {
     return string(buffer);
 }
 
+string makeCacheShardFilePath(const string &protoName, const string &directory, size_t index) {
+    // [protoName].N.glogmmap
+    return directory + protoName + "." + std::to_string(index) + CACHE_FILE_SUFFIX;
+}
+
+string makeCacheShardMarkerPath(const string &protoName, const string &directory) {
+    // [protoName].glogshards
+    return directory + protoName + CACHE_SHARD_MARKER_SUFFIX;
+}
+
+string makeStandbyCacheFilePath(const string &protoName, const string &directory) {
+    // [protoName].standby.glogmmap
+    return directory + protoName + STANDBY_CACHE_FILE_SUFFIX;
+}
+
 string makeArchiveFilePath(const string &protoName, const string &directory) {
     WallTime_t now = wallTimeNow();
     auto nowStamp = static_cast<time_t>(now);
@@ -916,6 +1569,10 @@ string makeArchiveFilePath(const string &protoName, const string &directory) {
     return string(buffer);
 }
 
+size_t roundUpToPageSize(size_t size) {
+    return (size + SYS_PAGE_SIZE - 1) / SYS_PAGE_SIZE * SYS_PAGE_SIZE;
+}
+
 size_t calculateRoundCacheSize() {
     // ensure cache size is multiple of page size
     // usually = 128 KB
@@ -972,9 +1629,11 @@ bool Glog::tryFlushAcrossDay() {
     }
     if (needFlush) {
         InternalDebug("flush cache to correct day");
-        m_cacheFile->msync();
+        mergeShards();
+        awaitStandby();
+        syncCacheFile(m_cacheFile);
         uint8_t maxDepth = MAX_RECURSION_DEPTH;
-        return appendLogFile(maxDepth, static_cast<time_t>(cacheCreateMs * 0.001));
+        return appendLogFile(m_cacheFile, maxDepth, static_cast<time_t>(cacheCreateMs * 0.001));
     }
     return false;
 }
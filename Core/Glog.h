@@ -6,12 +6,16 @@
 #define CORE__GLOG_H_
 
 #include "GlogPredef.h"
+#include <atomic>
 #include <chrono>
+#include <functional>
 #include <list>
+#include <memory>
 #include <regex>
 #include <string>
+#include <sys/uio.h>
 #include <unordered_map>
-#include <unordered_set>
+#include <vector>
 
 using namespace std;
 
@@ -19,11 +23,15 @@ namespace glog {
 class Glog;
 class GlogFile;
 class GlogReader;
+class GlogArchive;
 class GlogBuffer;
+class GlogBufferPool;
 class Compressor;
 class ThreadLock;
 class ConditionVariable;
 class MessageQueue;
+class WriterExecutor;
+enum class MessageType : uint8_t;
 
 extern size_t SYS_PAGE_SIZE;
 extern Endianness SYS_ENDIAN;
@@ -36,9 +44,23 @@ extern ThreadLock *g_daemonPollLock;
 extern ConditionVariable *g_daemonPollCond;
 extern atomic_bool g_daemonRunning;
 
+/**
+ * completion of Glog::flushAsync, flushed is false if glog is destroyed before flush runs
+ */
+typedef std::function<void(bool flushed)> FlushCallback;
+
+/**
+ * completion of Glog::getArchiveSnapshotAsync, archives are empty if glog is destroyed before snapshot runs
+ */
+typedef std::function<void(vector<string> &archives, const string &message)> ArchiveSnapshotCallback;
+
 extern string makeCacheFilePath(const string &protoName, const string &directory);
+extern string makeCacheShardFilePath(const string &protoName, const string &directory, size_t index);
+extern string makeCacheShardMarkerPath(const string &protoName, const string &directory);
+extern string makeStandbyCacheFilePath(const string &protoName, const string &directory);
 extern string makeArchiveFilePath(const string &protoName, const string &directory);
 extern size_t calculateRoundCacheSize();
+extern size_t roundUpToPageSize(size_t size);
 extern bool
 findLogFileOfDate(const string &rootDirectory, string &outFilename, const string &protoName, time_t epochSeconds);
 template <typename T>
@@ -49,8 +71,9 @@ public:
     /**
      * MUST call initialize before any call of instanceWithProto
      * @param logLevel glog internal log level, JUST for glog internal use.
+     * @param sharedWriterNum worker threads shared by async instances with sharedWriter = true.
      */
-    static void initialize(InternalLogLevel logLevel);
+    static void initialize(InternalLogLevel logLevel, size_t sharedWriterNum = DEFAULT_SHARED_WRITER_NUM);
 
     /**
      * Create new Glog instance if necessary. Glog will maintain a internal map (key - protoName, value - glog instance) as holder.
@@ -60,12 +83,22 @@ public:
      * protoName: proto name to identify Glog instance, will be part of file name.
      * rootDirectory: file root directory, Glog will create one cache file and multi archive files in it.
      * incrementalArchive: true - will flush cache to log archive of today, false - flush will just rename current cache to a new archive file and recreate cache
-     * async: write file in async mode or sync mode. Write in sync mode will block your code execution, async mode will put every write action into a FIFO queue.
+     * async: write file in async mode or sync mode. Write in sync mode will block your code execution, async mode will put every write action into a bounded FIFO queue, writer waits if the queue is full.
      * expireSeconds: file expires (now  - create time > expire seconds) will be deleted.
      * totalArchiveSizeLimit: total archive files size limit in bytes.
      * compressMode: current version (GlogStoreIVVersion) only support Zlib
      * encryptMode: current version (GlogStoreIVVersion) only support AES CBC-128
      * serverPublicKey: server public key for ECDH
+     * asyncMemoryBudget: max bytes of async logs waiting in queue, one log is always accepted if queue is empty
+     * overflowPolicy: what to do with a new async log once asyncMemoryBudget is used up, see OverflowPolicy
+     * overflowBlockTimeoutMillis: max time a writer waits for OverflowPolicy::Block
+     * overflowSampleRate: keep 1 of every N logs for OverflowPolicy::Sample
+     * sharedWriter: async mode only, write by worker threads shared with other instances instead of a dedicated thread.
+     *               logs of one instance are still written in order, instance with more pending logs is served first.
+     * cacheShardNum: sync mode only, > 1 spreads writer threads over [protoName].N.glogmmap shards (at most 16) with
+     *                their own lock and compressor. logs are numbered and merged into the cache file in write order
+     *                when a shard is full or on flush, so archives are the same as without shards.
+     *                each log is compressed alone (Z_FULL_FLUSH), compress ratio is lower than one shared stream.
      *
      * @return new Glog instance if not exists in internal map
      */
@@ -80,11 +113,45 @@ public:
 
     bool write(const GlogBuffer &log) { return m_async ? writeAsync(log) : writeSync(log); }
 
+    /**
+     * write log of any length, log longer than SINGLE_LOG_CONTENT_MAX_LENGTH (crash dump, network trace...) is
+     * split into chunk records which GlogReader puts together again. with incremental archive, cache is archived
+     * between chunks and log may be longer than cache. hard limits: without incremental archive the whole log MUST fit
+     * in cache, in async mode it MUST fit in MESSAGE_QUEUE_CAPACITY chunks of LOG_CHUNK_LENGTH (about 64MB).
+     */
+    bool write(const void *data, size_t length);
+
+    /**
+     * write logs in one call, logs are checked up front and nothing is written if any length is illegal.
+     * async mode: copy all logs into ONE queue message. sync mode: lock and check cache space once.
+     */
+    bool writeBatch(const struct iovec *logs, size_t num);
+
+    /**
+     * zero copy write, serialize log into the returned address (inside mmap cache) then call commit.
+     * ONLY available in sync mode without compression, encryption and cache shards, return nullptr otherwise or if fail.
+     * other writes on this instance are BLOCKED until commit, commit MUST be called on the same thread.
+     *
+     * @param length max log length to write
+     */
+    void *reserve(GlogBufferLength_t length);
+
+    /**
+     * finish the reservation, length <= reserved length, 0 means give up.
+     */
+    bool commit(GlogBufferLength_t length);
+
     /**
      * flush log in cache to archive file. Operation will BLOCK current thread.
      */
     void flush();
 
+    /**
+     * flush log in cache to archive file without blocking, callback is called in worker thread after
+     * logs written before are flushed. in sync mode it flushes and calls back in current thread.
+     */
+    void flushAsync(FlushCallback callback);
+
     static void destroy(const string &protoName);
 
     /**
@@ -105,14 +172,21 @@ public:
      * @param condition archive if one of the condition match
      * @param order archives file order
      *
-     * @return status message
+     * @return status message, archives are left empty if flush times out
      */
     string getArchiveSnapshot(vector<string> &archives,
                               const ArchiveCondition &condition,
                               FileOrder order = FileOrder::CreateTimeDescending);
 
     /**
-     * open archive file for reading, MUST call closeReader after read.
+     * take snapshot of archives without blocking, condition is checked and snapshot is taken in worker thread
+     * after logs written before, so the snapshot is never partial. in sync mode it runs in current thread.
+     */
+    void getArchiveSnapshotAsync(const ArchiveCondition &condition, FileOrder order, ArchiveSnapshotCallback callback);
+
+    /**
+     * open archive file for reading, MUST call closeReader after read. readers of the same archive share its
+     * descriptor and mapping but keep their own position, one reader per thread may read concurrently.
      */
     GlogReader *openReader(const string &archiveFile, const string *serverPrivateKey = nullptr);
     void closeReader(GlogReader *reader);
@@ -134,7 +208,7 @@ public:
     }
 
     /**
-     * get mmap cache size
+     * get mmap cache size, cache shards are not counted. adaptive cache applies it to the cache loaded next
      */
     size_t getCacheSize() const { return m_cacheSize; }
 
@@ -177,6 +251,21 @@ public:
 
     bool async() const { return m_async; }
 
+    /**
+     * millis before next periodicSync is due, -1 if sync policy is not SyncPolicy::Periodic
+     */
+    long millisToPeriodicSync(int64_t nowMillis) const;
+
+    /**
+     * MS_ASYNC cache and cache shards written since last msync if it is due, called by daemon
+     */
+    void periodicSync(int64_t nowMillis);
+
+    /**
+     * runtime counters of this instance
+     */
+    GlogStatistics getStatistics() const;
+
     // just forbid it for possibly misuse
     explicit Glog(const Glog &other) = delete;
     Glog &operator=(const Glog &other) = delete;
@@ -190,40 +279,185 @@ private:
          format::GlogCompressMode compressMode,
          format::GlogEncryptMode encryptMode,
          bool incrementalArchive,
-         const string *serverPublicKey);
+         const string *serverPublicKey,
+         size_t asyncMemoryBudget,
+         OverflowPolicy overflowPolicy,
+         long overflowBlockTimeoutMillis,
+         uint32_t overflowSampleRate,
+         WriterExecutor *writerExecutor,
+         size_t cacheShardNum,
+         bool standbyCache,
+         uint32_t cacheHighWaterPercent,
+         size_t cacheSize,
+         bool adaptiveCacheSize,
+         size_t maxCacheSize,
+         bool prefaultCache,
+         bool hugePageCache,
+         SyncPolicy syncPolicy,
+         long syncIntervalMillis);
 
     ~Glog();
 
     const string m_protoName;
     string m_rootDirectory;
-    size_t m_cacheSize;
+    atomic_size_t m_cacheSize; // files are loaded with it, read by archive queue
     atomic_int32_t m_expireSeconds;
     const size_t m_totalArchiveSizeLimit;
-    unordered_set<string> m_readingArchives; // guide by m_readingArchivesLock
+    struct ReadingArchive {
+        std::shared_ptr<GlogArchive> m_archive; // opened by first reader, shared by later ones
+        size_t m_readers = 0;
+    };
+    unordered_map<string, ReadingArchive> m_readingArchives; // guide by m_readingArchivesLock
     const format::GlogCompressMode m_compressMode;
     const format::GlogEncryptMode m_encryptMode;
     GlogFile *m_cacheFile;
     MessageQueue *m_writeQueue;
+    GlogBufferPool *m_bufferPool; // async log copies
     Compressor *m_compressor;
     ThreadLock *m_archiveLock;
-    ThreadLock *m_syncWriteLock;
+    ThreadLock *m_syncWriteLock; // guide cache file against periodic sync too, taken after m_archiveLock
     atomic_bool m_async;
     ThreadLock *m_readingArchivesLock;
     atomic_bool m_incrementalArchive;
     regex m_archiveNameRegex;
     atomic_bool m_shouldTryFlushAcrossDay;
+    pthread_t m_reserveThread; // guide by m_syncWriteLock
+    atomic_bool m_reserving;
+    const size_t m_asyncMemoryBudget;
+    const OverflowPolicy m_overflowPolicy;
+    const long m_overflowBlockTimeoutMillis;
+    const uint32_t m_overflowSampleRate;
+    atomic_size_t m_pendingAsyncBytes; // log copies enqueued but not written yet
+    atomic_int m_budgetWaiters;
+    atomic_uint32_t m_sampleCounter;
+    atomic_size_t m_droppedLogs;
+    atomic_size_t m_droppedBytes;
+    ThreadLock *m_budgetLock;
+    ConditionVariable *m_budgetCondition;
+
+    typedef struct CacheShard {
+        GlogFile *m_file;
+        Compressor *m_compressor;
+        ThreadLock *m_lock;
+    } CacheShard;
+
+    vector<CacheShard> m_shards;           // empty if no cache shard, merge takes m_syncWriteLock then all shard locks
+    std::atomic<uint64_t> m_shardSequence; // numbers logs of all shards
+
+    // full cache swaps content with standby and is archived by m_archiveQueue, null if standby cache is off.
+    // writers don't touch standby until it is ready again
+    GlogFile *m_standbyFile;
+    Compressor *m_standbyCompressor;
+    MessageQueue *m_archiveQueue;
+    atomic_bool m_standbyReady;
+    uint64_t m_archiveTicket;   // latest background archive, guide by m_syncWriteLock (worker thread in async mode)
+    const uint32_t m_highWaterPercent; // switch early once this percent of cache is written
+    atomic_size_t m_standbySwitches;
+    atomic_size_t m_standbyMisses;
+
+    // cache size adapts to write rate between the bounds if m_adaptiveCacheSize
+    const bool m_adaptiveCacheSize;
+    size_t m_minCacheSize;
+    size_t m_maxCacheSize;
+    int64_t m_cacheFillBeginMillis; // guide by m_syncWriteLock (worker thread in async mode)
+    atomic_size_t m_cacheResizes;
+    const bool m_prefaultCache;
+    const bool m_hugePageCache;
+    const SyncPolicy m_syncPolicy;
+    const long m_syncIntervalMillis;
+    int64_t m_lastPeriodicSyncMillis; // daemon thread only
+    atomic_size_t m_msyncCalls;
+    atomic_size_t m_msyncBytes;
+    bool m_skipChunks; // worker thread only, rest chunks of a long log are skipped once one fails
 
     bool writeSync(const GlogBuffer &log);
     bool writeAsync(const GlogBuffer &log);
 
+    // copy log and hand it to worker, length is checked by caller
+    bool enqueueAsyncLog(const void *data, size_t length);
+
+    // copy long log chunk by chunk into pooled slots and hand them to worker in one reservation
+    bool enqueueChunkedLog(const void *data, size_t length);
+
+    // write one chunk drained from m_writeQueue, shards are merged before the first one to keep order
+    bool writeQueuedChunk(const void *chunk, size_t length, format::GlogChunkType chunkType, size_t logLength);
+
+    // write chunks of a log longer than one record, shards are merged first to keep order
+    bool writeLargeSync(const void *data, size_t length);
+
+    // write logs drained from m_writeQueue, hold m_syncWriteLock once for the batch
+    bool writeSyncBatch(const struct iovec *logs, size_t num);
+
+    /**
+     * take length from async memory budget before enqueue, apply overflow policy if budget used up.
+     * return false if log should be dropped.
+     */
+    bool acquireAsyncBudget(size_t length);
+    bool tryAcquireAsyncBudget(size_t length);
+
+    // give back pool slot and budget of written or dropped logs
+    void releaseAsyncLog(void *block, size_t bytes);
+
+    bool writeBatchAsync(const struct iovec *logs, size_t num, size_t bytes);
+
+    // write to cache shard of current thread, merge shards if it is full
+    bool writeShard(const struct iovec *logs, size_t num);
+
+    // merge cache shards then flush cache file, MUST hold m_syncWriteLock
     bool internalFlush();
 
+    // archive or append cache file or standby, shards are not touched
+    bool flushCacheFile(GlogFile *file);
+
+    // msync cache file, standby or shard by m_syncPolicy, caller guides the file with its lock
+    void syncCacheFile(GlogFile *file);
+
+    /**
+     * called when cache is full, MUST hold m_syncWriteLock. hand logs to standby for background archive,
+     * wait for standby if it is still archiving, or archive cache in place if standby cache is off.
+     */
+    bool switchCacheFile();
+
+    // switch to standby before cache is full, MUST hold m_syncWriteLock
+    void maybeSwitchCacheFile();
+
+    /**
+     * pick size of the cache loaded next, MUST hold m_syncWriteLock. double it if cache fills up within
+     * CACHE_GROW_FILL_MILLIS, halve it if a flush finds cache less than a quarter used.
+     */
+    void adaptCacheSize(bool full);
+
+    // wait for background archive so archives keep log order, MUST hold m_syncWriteLock
+    void awaitStandby();
+
+    // run in m_archiveQueue, archive logs handed to standby then make it ready again
+    void archiveStandby();
+
+    // archive logs left in standby by last run before writing any log
+    void recoverStandby();
+
+    // move logs of all shards into cache file in write order, MUST hold m_syncWriteLock.
+    // whileLocked runs after merge with all shard locks still held
+    bool mergeShards(const std::function<void()> &whileLocked = nullptr);
+
+    // k-way merge logs of sequenced files into cache file by sequence number then clear them, MUST hold their locks
+    bool mergeSequencedFiles(const vector<GlogFile *> &files);
+
+    /**
+     * merge shards left by last run, including shards whose index is out of current shard num.
+     * only if shards are configured now or marked by last run, never touch a file of other proto
+     */
+    void recoverShards();
+
+    size_t cachedLogNum() const;
+    size_t cachedLogSize() const;
+
     /**
      * flush cache to log file of specified date,
      * remove and recreate cache file no matter it contains data or not,
      * if there is no data in cache, create a empty log file only contains header
      */
-    bool appendLogFile(uint8_t &maxRecursionDepth, time_t epochSeconds);
+    bool appendLogFile(GlogFile *file, uint8_t &maxRecursionDepth, time_t epochSeconds);
 
     /**
      * collect archives with current proto name, may limit the file numbers for performance
@@ -232,6 +466,28 @@ private:
 
     void doRemoveAll(bool removeReadingFiles, bool reloadCache);
 
+    /**
+     * check whether cache should be flushed for snapshot, describe condition and result in outMessage
+     */
+    bool checkSnapshotCondition(const ArchiveCondition &condition, FileOrder order, string &outMessage);
+
+    // fill archive paths, called with m_archiveLock or m_syncWriteLock held
+    void collectArchivePaths(vector<string> &archives, FileOrder order);
+
+    // task carried as context of flush message by async flush and snapshot, dropped if queue quit before it runs
+    typedef std::function<void(bool dropped)> AsyncFlushTask;
+
+    // flags of control messages
+    static const uint32_t FLUSH_ON_START = 1; // recover cache shards and flush cache created before today
+    static const uint32_t REMOVE_READING_FILES = 1;
+    static const uint32_t REMOVE_RELOAD_CACHE = 2;
+
+    // run flush and remove all message in worker
+    void handleControlMessage(MessageType type, uint32_t flags, void *context, bool dropped);
+
+    // hand task to worker, run it as dropped if queue already quit
+    void enqueueAsyncFlushTask(AsyncFlushTask *task);
+
     static void makeArchiveNameRegex(bool incrementalArchive, const string &protoName, regex &outRegex);
 };
 } // namespace glog
@@ -4,6 +4,7 @@
 
 #include "GlogBuffer.h"
 #include "GlogPredef.h"
+#include "MessageQueue.h"
 #include <cassert>
 #include <cerrno>
 #include <cstring>
@@ -37,4 +38,63 @@ GlogBuffer::~GlogBuffer() {
     }
 }
 
+// slot size and slot number of every tier, 256 KB each tier,
+// slab pages become resident only after slots on them are used.
+static const size_t POOL_TIER_SLOT_SIZES[] = {256, 1024, 4 * 1024, SINGLE_LOG_CONTENT_MAX_LENGTH};
+static const size_t POOL_TIER_SLOT_NUMS[] = {1024, 256, 64, 16};
+
+GlogBufferPool::GlogBufferPool() : m_hits(0), m_misses(0) {
+    for (int i = 0; i < TIER_NUM; ++i) {
+        Tier &tier = m_tiers[i];
+        tier.m_slotSize = POOL_TIER_SLOT_SIZES[i];
+        tier.m_slotNum = POOL_TIER_SLOT_NUMS[i];
+        tier.m_slab = static_cast<uint8_t *>(malloc(tier.m_slotSize * tier.m_slotNum));
+        if (!tier.m_slab) {
+            throw std::runtime_error(strerror(errno));
+        }
+        tier.m_freeSlots = new MpscRing<void *>(tier.m_slotNum);
+        for (size_t j = 0; j < tier.m_slotNum; ++j) {
+            void *slot = tier.m_slab + j * tier.m_slotSize;
+            tier.m_freeSlots->push(slot);
+        }
+    }
+}
+
+GlogBufferPool::~GlogBufferPool() {
+    for (auto &tier : m_tiers) {
+        delete tier.m_freeSlots;
+        free(tier.m_slab);
+    }
+}
+
+void *GlogBufferPool::acquire(size_t size) {
+    for (auto &tier : m_tiers) {
+        if (tier.m_slotSize < size) {
+            continue;
+        }
+        void *slot = nullptr;
+        // fitting tier exhausted, try a larger one before malloc
+        if (tier.m_freeSlots->pop(slot)) {
+            m_hits.fetch_add(1, std::memory_order_relaxed);
+            return slot;
+        }
+    }
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size);
+}
+
+void GlogBufferPool::release(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    auto *bytePtr = static_cast<uint8_t *>(ptr);
+    for (auto &tier : m_tiers) {
+        if (bytePtr >= tier.m_slab && bytePtr < tier.m_slab + tier.m_slotSize * tier.m_slotNum) {
+            tier.m_freeSlots->push(ptr);
+            return;
+        }
+    }
+    free(ptr);
+}
+
 } // namespace glog
@@ -6,9 +6,12 @@
 #define CORE_LOG_BUFFER_H_
 
 #include "GlogPredef.h"
+#include <atomic>
 #include <cstdlib>
 
 namespace glog {
+template <typename T>
+class MpscRing;
 
 // use as class member may cause free() same m_ptr multi times.
 class GlogBuffer {
@@ -49,5 +52,46 @@ private:
     bool m_isDeepCopy;
 };
 
+/**
+ * fixed size slots for async log copies, tiered to 256B / 1KB / 4KB / 16KB.
+ * slots are taken by any writer thread and given back by the queue worker,
+ * fall back to malloc when all slots of fitting tiers are in use.
+ */
+class GlogBufferPool {
+public:
+    GlogBufferPool();
+
+    ~GlogBufferPool();
+
+    /**
+     * get a slot with at least size bytes, nullptr if out of memory
+     */
+    void *acquire(size_t size);
+
+    void release(void *ptr);
+
+    size_t getHits() const { return m_hits.load(std::memory_order_relaxed); }
+
+    size_t getMisses() const { return m_misses.load(std::memory_order_relaxed); }
+
+    // just forbid it for possibly misuse
+    GlogBufferPool(const GlogBufferPool &other) = delete;
+    GlogBufferPool &operator=(const GlogBufferPool &other) = delete;
+
+private:
+    static const int TIER_NUM = 4;
+
+    struct Tier {
+        size_t m_slotSize;
+        size_t m_slotNum;
+        uint8_t *m_slab;
+        MpscRing<void *> *m_freeSlots;
+    };
+
+    Tier m_tiers[TIER_NUM];
+    std::atomic_size_t m_hits;
+    std::atomic_size_t m_misses;
+};
+
 } // namespace glog
 #endif // CORE_LOG_BUFFER_H_
\ No newline at end of file
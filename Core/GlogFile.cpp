@@ -8,12 +8,21 @@
 #include "aes/AESCrypt.h"
 #include "micro-ecc/uECC.h"
 #include "utilities.h"
+#include <algorithm>
 #include <cerrno>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <utility>
+#include <vector>
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#    include <immintrin.h>
+#    define GLOG_SIMD_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#    include <arm_neon.h>
+#    define GLOG_SIMD_NEON
+#endif
 
 namespace glog {
 
@@ -23,7 +32,9 @@ GlogFile::GlogFile(std::string path,
                    Compressor *compressor,
                    format::GlogCompressMode compressMode,
                    format::GlogEncryptMode encryptMode,
-                   const string *serverPublicKey)
+                   const string *serverPublicKey,
+                   std::atomic<uint64_t> *sequence,
+                   const MmapOptions &mmapOptions)
     : m_path(std::move(path))
     , m_protoName(std::move(protoName))
     , m_fd(-1)
@@ -36,7 +47,10 @@ GlogFile::GlogFile(std::string path,
     , m_compressor(compressor)
     , m_compressMode(compressMode)
     , m_encryptMode(encryptMode)
-    , m_headerSize(0) {
+    , m_headerSize(0)
+    , m_scratchBuffer(nullptr)
+    , m_sequence(sequence)
+    , m_mmapOptions(mmapOptions) {
     uint8_t depth = MAX_RECURSION_DEPTH;
     if (serverPublicKey && !serverPublicKey->empty()) {
         if (serverPublicKey->length() != ECC_PUBLIC_KEY_LEN * 2 || !str2Hex(*serverPublicKey, m_serverPublicKey)) {
@@ -47,6 +61,7 @@ GlogFile::GlogFile(std::string path,
     } else if (encryptMode == format::GlogEncryptMode::AES) {
         throw std::invalid_argument("should provide cipher key while encrypt mode = AES");
     }
+    m_scratchBuffer = new GlogBuffer(SINGLE_LOG_CONTENT_MAX_LENGTH);
     m_loadFileCompleted = loadFromDisk(depth, specifiedSize);
 }
 
@@ -103,7 +118,9 @@ bool GlogFile::loadFromDisk(uint8_t &maxRecursionDepth, size_t specifiedSize) {
     if (m_size == 0) {
         isBrandNewFile = true;
     } else if (m_size > 0) {
-        HeaderMismatchReason reason = readHeader(m_fd, m_path, m_size, m_protoName, &m_headerSize, nullptr);
+        GlogByte_t fileVersionCode = 0;
+        HeaderMismatchReason reason =
+            readHeader(m_fd, m_path, m_size, m_protoName, &m_headerSize, &fileVersionCode, versionCode());
         InternalDebug("cache file [%s] already exist", m_path.c_str());
         if (reason != HeaderMismatchReason::None) {
             int ret = ::remove(m_path.c_str());
@@ -115,10 +132,15 @@ bool GlogFile::loadFromDisk(uint8_t &maxRecursionDepth, size_t specifiedSize) {
             }
             return loadFromDisk(maxRecursionDepth, specifiedSize);
         }
+        // cache left by older version, chunks may be appended from now on
+        if (fileVersionCode != static_cast<GlogByte_t>(versionCode())) {
+            upgradeVersionCode(m_fd, m_path, versionCode());
+        }
     } else {
         InternalError("fail get file [%s] size", m_path.c_str());
         return false;
     }
+    const size_t diskSize = m_size;
     bool truncated = true;
     if (m_size != specifiedSize) {
         truncated = GlogFile::truncate(specifiedSize);
@@ -157,14 +179,24 @@ bool GlogFile::loadFromDisk(uint8_t &maxRecursionDepth, size_t specifiedSize) {
         m_totalLogNum = 0;
         m_totalLogSize = 0;
         m_position = m_headerSize;
-    } else {
+    } else if (!loadCheckpoint()) {
         // calculate current position
         calculatePosition();
     }
+    // checkpoint of the file before it grows is left among zeros
+    if (diskSize < m_size && diskSize >= m_position + format::CHECKPOINT_LENGTH) {
+        ::memset(static_cast<uint8_t *>(m_ptr) + diskSize - format::CHECKPOINT_LENGTH, 0, format::CHECKPOINT_LENGTH);
+    }
+    saveCheckpoint();
     if (m_compressor) {
         m_compressor->reset();
     }
     m_cipherReady = resetAesKey();
+    // nothing of the file is known on disk yet
+    m_syncedPosition = m_dirtyEnd = 0;
+    if (m_mmapOptions.m_prefault) {
+        prefault();
+    }
     InternalDebug("end load file [%s] actual size:%zu, file disk size:%zu", m_path.c_str(), m_position.load(),
                   m_size.load());
     return true;
@@ -220,24 +252,115 @@ bool GlogFile::zeroFillFile(int fd, size_t startPos, size_t size) {
 }
 
 bool GlogFile::mmap() {
-    m_ptr = ::mmap(m_ptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    if (m_mmapOptions.m_prefault) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void *addr = m_ptr;
+#ifdef MADV_HUGEPAGE
+    // huge page must be aligned in virtual address, map into an aligned part of a larger reservation
+    void *reserved = MAP_FAILED;
+    const size_t reservedSize = m_size + HUGE_PAGE_SIZE;
+    if (m_mmapOptions.m_hugePage && m_size >= HUGE_PAGE_SIZE) {
+        reserved = ::mmap(nullptr, reservedSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (reserved != MAP_FAILED) {
+            auto aligned = (reinterpret_cast<uintptr_t>(reserved) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+            addr = reinterpret_cast<void *>(aligned);
+            flags |= MAP_FIXED;
+        }
+    }
+#endif
+    m_ptr = ::mmap(addr, m_size, PROT_READ | PROT_WRITE, flags, m_fd, 0);
+#ifdef MADV_HUGEPAGE
+    if (reserved != MAP_FAILED) {
+        auto *reservedBegin = static_cast<uint8_t *>(reserved);
+        auto *mappedBegin = static_cast<uint8_t *>(addr);
+        if (m_ptr == MAP_FAILED) {
+            ::munmap(reserved, reservedSize);
+        } else {
+            // give back reservation around the mapping
+            if (mappedBegin > reservedBegin) {
+                ::munmap(reservedBegin, mappedBegin - reservedBegin);
+            }
+            if (mappedBegin + m_size < reservedBegin + reservedSize) {
+                ::munmap(mappedBegin + m_size, reservedBegin + reservedSize - mappedBegin - m_size);
+            }
+        }
+    }
+#endif
     if (m_ptr == MAP_FAILED) {
         InternalError("fail to mmap [%s], %s", m_path.c_str(), strerror(errno));
         m_ptr = nullptr;
         return false;
     }
+#ifdef MADV_HUGEPAGE
+    if (m_mmapOptions.m_hugePage && ::madvise(m_ptr, m_size, MADV_HUGEPAGE) != 0) {
+        InternalDebug("no huge page for [%s], %s", m_path.c_str(), strerror(errno));
+    }
+#endif
     return true;
 }
 
-bool GlogFile::msync(SyncFlag syncFlag) {
-    if (m_ptr && m_ptr != MAP_FAILED) {
-        auto ret = ::msync(m_ptr, m_size, syncFlag == SyncFlag::Glog_SYNC ? MS_SYNC : MS_ASYNC);
-        if (ret == 0) {
+void GlogFile::prefault() {
+#ifndef MAP_POPULATE
+    if (::madvise(m_ptr, m_size, MADV_WILLNEED) != 0) {
+        InternalDebug("fail to madvise [%s], %s", m_path.c_str(), strerror(errno));
+    }
+#endif
+    // populated page of shared mapping is still read only until first write, write each page once now.
+    // bytes after write position are not logs, write them back as they are
+    auto *ptr = static_cast<volatile uint8_t *>(m_ptr);
+    for (size_t offset = m_position; offset < m_size; offset = (offset / SYS_PAGE_SIZE + 1) * SYS_PAGE_SIZE) {
+        ptr[offset] = ptr[offset];
+    }
+}
+
+bool GlogFile::msync(SyncFlag syncFlag, bool dirtyOnly, size_t *outSyncedBytes) {
+    if (outSyncedBytes) {
+        *outSyncedBytes = 0;
+    }
+    if (!m_ptr || m_ptr == MAP_FAILED) {
+        return false;
+    }
+    const int flags = syncFlag == SyncFlag::Glog_SYNC ? MS_SYNC : MS_ASYNC;
+    size_t begin = 0;
+    size_t end = m_size;
+    size_t syncedBytes = 0;
+    if (dirtyOnly) {
+        begin = std::min(m_syncedPosition, m_position.load()) / SYS_PAGE_SIZE * SYS_PAGE_SIZE;
+        end = std::min(std::max(m_dirtyEnd, m_position.load()), m_size.load());
+        // checkpoint lies in the last page, far after logs unless the file is nearly full
+        const size_t checkpointBegin = (m_size - format::CHECKPOINT_LENGTH) / SYS_PAGE_SIZE * SYS_PAGE_SIZE;
+        if (m_checkpointDirty && m_size >= format::CHECKPOINT_LENGTH && checkpointBegin >= end) {
+            if (::msync(static_cast<uint8_t *>(m_ptr) + checkpointBegin, m_size - checkpointBegin, flags) != 0) {
+                InternalError("fail to msync checkpoint [%s] offset:%zu, %s", m_path.c_str(), checkpointBegin,
+                              strerror(errno));
+                return false;
+            }
+            syncedBytes = m_size - checkpointBegin;
+        }
+        if (begin >= end) {
+            m_checkpointDirty = false;
+            if (outSyncedBytes) {
+                *outSyncedBytes = syncedBytes;
+            }
             return true;
         }
-        InternalError("fail to msync [%s], %s", m_path.c_str(), strerror(errno));
     }
-    return false;
+    auto ret = ::msync(static_cast<uint8_t *>(m_ptr) + begin, end - begin, flags);
+    if (ret != 0) {
+        InternalError("fail to msync [%s] offset:%zu size:%zu, %s", m_path.c_str(), begin, end - begin,
+                      strerror(errno));
+        return false;
+    }
+    m_syncedPosition = m_dirtyEnd = m_position;
+    m_checkpointDirty = false;
+    if (outSyncedBytes) {
+        *outSyncedBytes = syncedBytes + end - begin;
+    }
+    return true;
 }
 
 void GlogFile::closeFile() {
@@ -259,6 +382,28 @@ void GlogFile::closeFile() {
     m_totalLogNum = m_totalLogSize = 0;
 }
 
+void GlogFile::swapContent(GlogFile &other) {
+    auto swapAtomic = [](atomic_size_t &lhs, atomic_size_t &rhs) { lhs = rhs.exchange(lhs); };
+
+    std::swap(m_path, other.m_path);
+    std::swap(m_fd, other.m_fd);
+    std::swap(m_ptr, other.m_ptr);
+    swapAtomic(m_size, other.m_size);
+    std::swap(m_headerSize, other.m_headerSize);
+    swapAtomic(m_position, other.m_position);
+    swapAtomic(m_totalLogNum, other.m_totalLogNum);
+    swapAtomic(m_totalLogSize, other.m_totalLogSize);
+    m_loadFileCompleted = other.m_loadFileCompleted.exchange(m_loadFileCompleted);
+    std::swap(m_compressor, other.m_compressor);
+    std::swap(m_clientPublicKey, other.m_clientPublicKey);
+    std::swap(m_aesKey, other.m_aesKey);
+    std::swap(m_cipherReady, other.m_cipherReady);
+    std::swap(m_reservedLength, other.m_reservedLength);
+    std::swap(m_syncedPosition, other.m_syncedPosition);
+    std::swap(m_dirtyEnd, other.m_dirtyEnd);
+    std::swap(m_checkpointDirty, other.m_checkpointDirty);
+}
+
 #ifdef GLOG_APPLE
 void GlogFile::tryResetFileProtection(const string &path) {
     @autoreleasepool {
@@ -281,7 +426,137 @@ void GlogFile::tryResetFileProtection(const string &path) {
 #endif // GLOG_APPLE
 
 int64_t GlogFile::searchSyncMarker(const uint8_t *src, size_t len) {
-    return searchNeedle(src, len, format::SYNC_MARKER, format::SYNC_MARKER_LENGTH, false);
+    return findSyncMarker(src, len);
+}
+
+// memchr first byte of marker (vectorized by libc), then compare all of it
+static int64_t findSyncMarkerScalar(const uint8_t *haystack, size_t haystackLen) {
+    using format::SYNC_MARKER;
+    using format::SYNC_MARKER_LENGTH;
+
+    size_t i = 0;
+    while (i + SYNC_MARKER_LENGTH <= haystackLen) {
+        const size_t starts = haystackLen - SYNC_MARKER_LENGTH + 1 - i; // where a marker may begin
+        const auto *found = static_cast<const uint8_t *>(::memchr(haystack + i, SYNC_MARKER[0], starts));
+        if (!found) {
+            return -1;
+        }
+        i = found - haystack;
+        if (::memcmp(found, SYNC_MARKER, SYNC_MARKER_LENGTH) == 0) {
+            return static_cast<int64_t>(i);
+        }
+        i++;
+    }
+    return -1;
+}
+
+// scalar search of bytes left by a vector loop stopping at offset
+static int64_t findSyncMarkerTail(const uint8_t *haystack, size_t haystackLen, size_t offset) {
+    int64_t ret = findSyncMarkerScalar(haystack + offset, haystackLen - offset);
+    return ret < 0 ? -1 : static_cast<int64_t>(offset) + ret;
+}
+
+// vector of first marker byte at i and vector of last marker byte at i + 7 both equal, then compare the 6 between.
+// candidates are rare in log bytes, a whole vector is skipped at a time
+#define __CHECK_SYNC_MARKER_CANDIDATES(mask, bitsPerByte)                                                              \
+    while (mask) {                                                                                                     \
+        size_t candidate = i + __builtin_ctzll(mask) / (bitsPerByte);                                                  \
+        if (::memcmp(haystack + candidate + 1, format::SYNC_MARKER + 1, format::SYNC_MARKER_LENGTH - 2) == 0) {        \
+            return static_cast<int64_t>(candidate);                                                                    \
+        }                                                                                                              \
+        mask &= mask - 1;                                                                                              \
+    }
+
+#ifdef GLOG_SIMD_X86
+static int64_t findSyncMarkerSSE2(const uint8_t *haystack, size_t haystackLen) {
+    const size_t last = format::SYNC_MARKER_LENGTH - 1;
+    const __m128i first = _mm_set1_epi8(static_cast<char>(format::SYNC_MARKER[0]));
+    const __m128i tail = _mm_set1_epi8(static_cast<char>(format::SYNC_MARKER[last]));
+    size_t i = 0;
+    for (; i + sizeof(__m128i) + last <= haystackLen; i += sizeof(__m128i)) {
+        __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + i));
+        __m128i end = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + i + last));
+        auto mask = static_cast<uint64_t>(
+            _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(end, tail))));
+        __CHECK_SYNC_MARKER_CANDIDATES(mask, 1)
+    }
+    return findSyncMarkerTail(haystack, haystackLen, i);
+}
+
+__attribute__((target("avx2"))) static int64_t findSyncMarkerAVX2(const uint8_t *haystack, size_t haystackLen) {
+    const size_t last = format::SYNC_MARKER_LENGTH - 1;
+    const __m256i first = _mm256_set1_epi8(static_cast<char>(format::SYNC_MARKER[0]));
+    const __m256i tail = _mm256_set1_epi8(static_cast<char>(format::SYNC_MARKER[last]));
+    size_t i = 0;
+    for (; i + sizeof(__m256i) + last <= haystackLen; i += sizeof(__m256i)) {
+        __m256i head = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(haystack + i));
+        __m256i end = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(haystack + i + last));
+        auto mask = static_cast<uint64_t>(static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(end, tail)))));
+        __CHECK_SYNC_MARKER_CANDIDATES(mask, 1)
+    }
+    return findSyncMarkerTail(haystack, haystackLen, i);
+}
+#endif // GLOG_SIMD_X86
+
+#ifdef GLOG_SIMD_NEON
+static int64_t findSyncMarkerNEON(const uint8_t *haystack, size_t haystackLen) {
+    const size_t last = format::SYNC_MARKER_LENGTH - 1;
+    const uint8x16_t first = vdupq_n_u8(format::SYNC_MARKER[0]);
+    const uint8x16_t tail = vdupq_n_u8(format::SYNC_MARKER[last]);
+    size_t i = 0;
+    for (; i + sizeof(uint8x16_t) + last <= haystackLen; i += sizeof(uint8x16_t)) {
+        uint8x16_t head = vceqq_u8(vld1q_u8(haystack + i), first);
+        uint8x16_t eq = vandq_u8(head, vceqq_u8(vld1q_u8(haystack + i + last), tail));
+        // narrow every byte of 0x00 / 0xff to a nibble, NEON has no movemask
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0) &
+                        0x8888888888888888ull;
+        __CHECK_SYNC_MARKER_CANDIDATES(mask, 4)
+    }
+    return findSyncMarkerTail(haystack, haystackLen, i);
+}
+#endif // GLOG_SIMD_NEON
+
+#undef __CHECK_SYNC_MARKER_CANDIDATES
+
+SyncMarkerSearch bestSyncMarkerSearch() {
+    static const SyncMarkerSearch best = []() {
+#if defined(GLOG_SIMD_X86)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? SyncMarkerSearch::AVX2 : SyncMarkerSearch::SSE2;
+#elif defined(GLOG_SIMD_NEON)
+        return SyncMarkerSearch::NEON;
+#else
+        return SyncMarkerSearch::Scalar;
+#endif
+    }();
+    return best;
+}
+
+int64_t findSyncMarker(const uint8_t *haystack, size_t haystackLen) {
+    return findSyncMarker(haystack, haystackLen, bestSyncMarkerSearch());
+}
+
+int64_t findSyncMarker(const uint8_t *haystack, size_t haystackLen, SyncMarkerSearch search) {
+    if (!haystack || haystackLen < format::SYNC_MARKER_LENGTH) {
+        return -1;
+    }
+    const bool supported = search == SyncMarkerSearch::Scalar || search == SyncMarkerSearch::SSE2 ||
+                           search == bestSyncMarkerSearch();
+    switch (supported ? search : SyncMarkerSearch::Scalar) {
+#ifdef GLOG_SIMD_X86
+        case SyncMarkerSearch::SSE2:
+            return findSyncMarkerSSE2(haystack, haystackLen);
+        case SyncMarkerSearch::AVX2:
+            return findSyncMarkerAVX2(haystack, haystackLen);
+#endif
+#ifdef GLOG_SIMD_NEON
+        case SyncMarkerSearch::NEON:
+            return findSyncMarkerNEON(haystack, haystackLen);
+#endif
+        default:
+            return findSyncMarkerScalar(haystack, haystackLen);
+    }
 }
 
 // When comparing signed with unsigned, the compiler converts the signed value to unsigned
@@ -321,30 +596,31 @@ searchNeedle(const uint8_t *haystack, int64_t haystackLen, const uint8_t *needle
     return -1;
 }
 
+// bytes read at a time when recovering a corrupted file
+static const size_t SYNC_MARKER_SEARCH_BLOCK_SIZE = 64 * 1024;
+
 int64_t searchSyncMarkerInFile(const string &path, int fd, off_t offset, size_t size) {
     if (size <= offset || format::SYNC_MARKER_LENGTH > size - offset) {
         return -1;
     }
-    int64_t i = offset, j = 0;
-    while (i < size && j < format::SYNC_MARKER_LENGTH) {
-        uint8_t haystackElement;
-        if (::lseek(fd, i, SEEK_SET) < 0) {
-            InternalError("fail to lseek file [%s], %s", path.c_str(), strerror(errno));
-            return -1;
-        }
-        if (::read(fd, &haystackElement, 1) <= 0) {
+    // consecutive blocks overlap by marker length - 1 bytes, a marker across two blocks is not missed
+    std::vector<uint8_t> block(std::min(SYNC_MARKER_SEARCH_BLOCK_SIZE, size - offset));
+    size_t blockBegin = offset;
+    while (true) {
+        size_t want = std::min(block.size(), size - blockBegin);
+        ssize_t got = ::pread(fd, block.data(), want, static_cast<off_t>(blockBegin));
+        if (got < 0) {
             InternalError("fail to read file [%s], %s", path.c_str(), strerror(errno));
             return -1;
         }
-        if (j == -1 || haystackElement == format::SYNC_MARKER[j]) {
-            i++;
-            j++;
-        } else {
-            j = g_forwardPartialMatchTable[j];
+        int64_t found = findSyncMarker(block.data(), static_cast<size_t>(got));
+        if (found >= 0) {
+            return static_cast<int64_t>(blockBegin) + found;
         }
-    }
-    if (j == format::SYNC_MARKER_LENGTH) {
-        return i - j;
+        if (static_cast<size_t>(got) < want || blockBegin + got >= size) {
+            break;
+        }
+        blockBegin += got - (format::SYNC_MARKER_LENGTH - 1);
     }
     return -1;
 }
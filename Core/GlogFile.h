@@ -11,13 +11,33 @@
 #include "Glog_IO.h"
 #include "InternalLog.h"
 #include "openssl/openssl_aes.h"
+#include <atomic>
 #include <string>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <functional>
 
 namespace glog {
 
+/**
+ * a record inside mmap of a sequenced file (cache shard)
+ */
+typedef struct SequencedRecord {
+    uint64_t m_sequence;
+    const uint8_t *m_ptr;        // start at mode set
+    size_t m_storeSize;          // bytes from mode set to the end of sync marker
+    GlogBufferLength_t m_length; // log data length
+} SequencedRecord;
+
+/**
+ * how a file is mapped, see GlogConfig::m_prefaultCache and m_hugePageCache
+ */
+typedef struct MmapOptions {
+    bool m_prefault = false;
+    bool m_hugePage = false;
+} MmapOptions;
+
 class GlogFile {
     friend class Glog;
 
@@ -28,18 +48,25 @@ public:
              Compressor *compressor,
              format::GlogCompressMode compressMode,
              format::GlogEncryptMode encryptMode,
-             const string *serverPublicKey);
+             const string *serverPublicKey,
+             std::atomic<uint64_t> *sequence = nullptr,
+             const MmapOptions &mmapOptions = MmapOptions());
 
     ~GlogFile() {
         if (isFileAlreadyOpen()) {
-            GlogFile::msync();
+            GlogFile::msync(SyncFlag::Glog_SYNC, true);
             GlogFile::closeFile();
         }
+        delete m_scratchBuffer;
     }
 
     bool mmap();
 
-    bool msync(SyncFlag syncFlag = SyncFlag::Glog_SYNC);
+    /**
+     * dirtyOnly syncs pages written (or zeroed by clear) since last msync instead of the whole file.
+     * outSyncedBytes is 0 if nothing to sync
+     */
+    bool msync(SyncFlag syncFlag = SyncFlag::Glog_SYNC, bool dirtyOnly = false, size_t *outSyncedBytes = nullptr);
 
     bool loadFromDisk(uint8_t &maxRecursionDepth, size_t specifiedSize);
 
@@ -61,26 +88,80 @@ public:
     // write log and its length in front of it
     bool writeLogData(const GlogBuffer &data, const std::function<bool(uint32_t length)> &insufficientSpaceCallback);
 
-    // calculate header size + log data size after mmap
+    /**
+     * write log longer than SINGLE_LOG_CONTENT_MAX_LENGTH as chunk records next to each other. cache is archived
+     * between chunks whenever it fills up, or only before the first one if withinOneCache.
+     */
+    bool writeLargeLogData(const void *data,
+                           size_t length,
+                           const std::function<bool(uint32_t length)> &insufficientSpaceCallback,
+                           bool withinOneCache);
+
+    // write one chunk of a long log as a record of chunkType
+    bool writeChunkData(const GlogBuffer &chunk,
+                        format::GlogChunkType chunkType,
+                        const std::function<bool(uint32_t length)> &insufficientSpaceCallback);
+
+    /**
+     * archive cache first if all chunks of a log of length may not fit in space left,
+     * fail if they may not fit in an empty cache.
+     */
+    bool makeRoomForChunks(size_t length, const std::function<bool(uint32_t length)> &insufficientSpaceCallback);
+
+    // write logs in one pass, space is checked once for the whole batch
+    bool writeLogBatch(const struct iovec *logs,
+                       size_t num,
+                       const std::function<bool(uint32_t length)> &insufficientSpaceCallback);
+
+    /**
+     * reserve space of a plain log (no compression, no encryption) and return the content address in mmap,
+     * nothing is visible until commitLogData. return nullptr if fail.
+     */
+    void *reserveLogData(GlogBufferLength_t length,
+                         const std::function<bool(uint32_t length)> &insufficientSpaceCallback);
+
+    // write mode set, length and sync marker around reserved content, length 0 abandons the reservation
+    bool commitLogData(GlogBufferLength_t length);
+
+    // calculate header size + log data size after mmap by walking every record
     void calculatePosition();
 
+    /**
+     * sequenced file only, read next record from offset (file start based) and move offset to the end of it,
+     * broken bytes are skipped. return false if no more record before write position.
+     */
+    bool nextSequencedRecord(size_t &offset, SequencedRecord &outRecord) const;
+
+    // copy record of a sequenced file without its sequence number, return false if no space left for it
+    bool appendSequencedRecord(const SequencedRecord &record);
+
+    // zero written logs, reset write position, compressor and cipher
+    void clear();
+
+    // exchange file, mmap, write state, compressor and cipher with other file of the same proto
+    void swapContent(GlogFile &other);
+
     // write position
     size_t getPosition() const { return m_position; }
 
     // data length exclude header
     size_t getDataLength() const { return m_position - m_headerSize; }
 
+    // bytes logs may still take, checkpoint excluded
     size_t spaceLeft() const {
-        if (m_size <= m_position) {
+        if (m_size <= m_position + format::CHECKPOINT_LENGTH) {
             return 0;
         }
-        return m_size - m_position;
+        return m_size - m_position - format::CHECKPOINT_LENGTH;
     }
 
     size_t getTotalLogNum() const { return m_totalLogNum; }
 
     size_t getTotalLogSize() const { return m_totalLogSize; }
 
+    // chunks of a long log not finished yet are no log in number, but they still make cache not empty
+    bool isEmpty() const { return m_totalLogSize == 0; }
+
     size_t getHeaderSize() const { return m_headerSize; }
 
     void resetInternalState() {
@@ -109,12 +190,56 @@ private:
     openssl::AES_KEY m_aesKey = {};
     bool m_cipherReady = false;
     bool m_svrPubKeyReady = false;
+    GlogBufferLength_t m_reservedLength = 0; // 0 if no reservation
+    format::GlogChunkType m_chunkType = format::GlogChunkType::Whole; // of the record being written
+    GlogBuffer *m_scratchBuffer;             // compress & encrypt output, reused by every write
+    std::atomic<uint64_t> *m_sequence;       // not null for cache shard, stamp every log with a number from it
+    const MmapOptions m_mmapOptions;
+    size_t m_syncedPosition = 0; // write position at last msync
+    size_t m_dirtyEnd = 0;       // end of logs zeroed by clear() since last msync
+    bool m_checkpointDirty = false; // checkpoint at file end written since last msync
+
+    format::GlogVersion versionCode() const {
+        return m_sequence ? format::GlogVersion::GlogSequenceVersion : format::GlogVersion::GlogChunkVersion;
+    }
+
+    // mode set, [sequence], [iv, client public key] and length
+    uint8_t recordHeaderSize(bool cipher) const {
+        return logHeaderSize(cipher) + (m_sequence ? format::SEQUENCE_BYTES : 0);
+    }
+
+    uint32_t recordStoreSize(GlogBufferLength_t logLength, bool cipher) const {
+        return recordHeaderSize(cipher) + logLength + format::SYNC_MARKER_LENGTH;
+    }
 
     static int64_t searchSyncMarker(const uint8_t *src, size_t len);
 
+    // write mode set, [iv, client public key], length, content and sync marker, space MUST be enough
+    bool appendRecord(const GlogBuffer &content, bool cipher, const uint8_t *iv);
+
+    // content is already at recordContentPtr(cipher), write the rest of record around it
+    bool commitRecord(GlogBufferLength_t length, bool cipher, const uint8_t *iv);
+
+    // compress (and encrypt) data directly into mmap, space MUST be enough for compressor's bound
+    bool compressInPlace(const GlogBuffer &data, bool cipher);
+
+    // where the content of next record starts in mmap
+    uint8_t *recordContentPtr(bool cipher) const {
+        return static_cast<uint8_t *>(m_ptr) + m_position + recordHeaderSize(cipher);
+    }
+
+    // write position, log num and size to checkpoint, skipped if logs of an older version reach it
+    void saveCheckpoint();
+
+    // restore write position, log num and size from checkpoint, false if it fails validation
+    bool loadCheckpoint();
+
     // truncate size and redo mmap if needed
     bool truncate(size_t size);
 
+    // fault in pages after write position, so writes to them never stall on page fault
+    void prefault();
+
     bool resetAesKey();
 
     static bool zeroFillFile(int fd, size_t startPos, size_t size);
@@ -132,7 +257,11 @@ extern HeaderMismatchReason readHeader(int fd,
                                        size_t fileSize,
                                        const string &protoName,
                                        size_t *outHeaderSize = nullptr,
-                                       GlogByte_t *outVersionCode = nullptr);
+                                       GlogByte_t *outVersionCode = nullptr,
+                                       format::GlogVersion versionCode = format::GlogVersion::GlogChunkVersion);
+
+// rewrite version code in header of an opened file, used to upgrade a GlogCipherVersion file to GlogChunkVersion
+extern bool upgradeVersionCode(int fd, const string &path, format::GlogVersion versionCode);
 
 /*
  * kmp search needle in haystack, backward means search from haystack's last position.
@@ -143,6 +272,27 @@ extern HeaderMismatchReason readHeader(int fd,
  */
 extern int64_t
 searchNeedle(const uint8_t *haystack, int64_t haystackLen, const uint8_t *needle, int64_t needleLen, bool backward);
+/**
+ * search sync marker in [offset, size) of file, blocks of file are read and searched in memory
+ * return absolute position of marker or -1
+ */
 extern int64_t searchSyncMarkerInFile(const string &path, int fd, off_t offset, size_t size);
+
+/**
+ * how findSyncMarker compares bytes, SSE2 and AVX2 on x86, NEON on ARM
+ */
+enum class SyncMarkerSearch : uint8_t { Scalar = 0, SSE2 = 1, AVX2 = 2, NEON = 3 };
+
+// fastest search this cpu supports, detected once
+extern SyncMarkerSearch bestSyncMarkerSearch();
+
+/**
+ * forward search first SYNC_MARKER in haystack, return its offset or -1.
+ * same result as searchNeedle(haystack, len, SYNC_MARKER, SYNC_MARKER_LENGTH, false), many bytes per step
+ */
+extern int64_t findSyncMarker(const uint8_t *haystack, size_t haystackLen);
+
+// with given search, falls back to scalar if cpu doesn't support it
+extern int64_t findSyncMarker(const uint8_t *haystack, size_t haystackLen, SyncMarkerSearch search);
 } // namespace glog
 #endif //CORE_LOG_FILE_H_
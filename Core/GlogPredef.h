@@ -50,15 +50,52 @@ typedef uint16_t GlogBufferLength_t;
 typedef unsigned char GlogByte_t;
 
 constexpr auto CACHE_FILE_SUFFIX = ".glogmmap";
+constexpr auto STANDBY_CACHE_FILE_SUFFIX = ".standby.glogmmap";
+constexpr auto CACHE_SHARD_MARKER_SUFFIX = ".glogshards";
 constexpr auto ARCHIVE_FILE_SUFFIX = ".glog";
 constexpr auto MESSAGE_QUEUE_THREAD_NAME = "glog-core-mq";
 constexpr auto DAEMON_THREAD_NAME = "glog-core-dm";
+constexpr auto SHARED_WRITER_THREAD_NAME = "glog-core-sw";
 // 7 days expires
 const int32_t DEFAULT_EXPIRES_SECS = 7 * 24 * 60 * 60;
 // 16 MB total archives
 const size_t DEFAULT_TOTAL_ARCHIVE_SIZE_LIMIT = 16 * 1024 * 1024;
 
 const int DEFAULT_TOTAL_ARCHIVE_NUM_LIMIT = 30;
+
+// slots of async write queue, producers wait for the worker when all slots are taken
+const size_t MESSAGE_QUEUE_CAPACITY = 4096;
+const size_t MESSAGE_QUEUE_BATCH_SIZE = 256; // max messages worker drains at one time
+const size_t ARCHIVE_QUEUE_CAPACITY = 4;      // at most one standby archive pending
+
+// 2 MB of async log copies waiting for worker
+const size_t DEFAULT_ASYNC_MEMORY_BUDGET = 2 * 1024 * 1024;
+const long DEFAULT_OVERFLOW_BLOCK_TIMEOUT_MILLIS = 100;
+const uint32_t DEFAULT_OVERFLOW_SAMPLE_RATE = 10; // keep 1 of 10 logs
+
+const size_t DEFAULT_SHARED_WRITER_NUM = 2;
+
+const size_t DEFAULT_CACHE_SHARD_NUM = 1;
+const size_t MAX_CACHE_SHARD_NUM = 16;
+
+// bounds of configurable cache size, default is calculateRoundCacheSize()
+const size_t MIN_CACHE_SIZE = 64 * 1024; // leaves room for the largest log with cipher header
+const size_t MAX_CACHE_SIZE = 16 * 1024 * 1024;
+const size_t DEFAULT_MAX_ADAPTIVE_CACHE_SIZE = 1024 * 1024;
+// adaptive cache grows if it fills up faster than this
+const int64_t CACHE_GROW_FILL_MILLIS = 30 * 1000;
+// archive name is in millis, wait at most this many millis for a name not taken
+const int MAX_ARCHIVE_NAME_RETRY = 3;
+
+// switch to standby cache once cache is 90% full, so the next log rarely waits for the switch
+const uint32_t DEFAULT_CACHE_HIGH_WATER_PERCENT = 90;
+
+// MS_ASYNC the cache once a second for SyncPolicy::Periodic
+const long DEFAULT_SYNC_INTERVAL_MILLIS = 1000;
+
+constexpr size_t CACHE_LINE_SIZE = 64;
+// transparent huge page size of arm64 and x86_64 with 4KB base page
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
 namespace format {
 
 /**
@@ -84,15 +121,33 @@ enum class GlogVersion : GlogByte_t {
      * store iv and public key in each log to support AES CFB-128 encrypt
      */
     GlogCipherVersion = 0x4,
+
+    /**
+     * store sequence number after mode set of each log, ONLY used by cache shards, archives stay GlogCipherVersion
+     */
+    GlogSequenceVersion = 0x5,
+
+    /**
+     * log longer than SINGLE_LOG_CONTENT_MAX_LENGTH is split into chunk records marked in mode set,
+     * a GlogCipherVersion file is a valid GlogChunkVersion file without chunks
+     */
+    GlogChunkVersion = 0x6,
 };
 
 const GlogByte_t MAGIC_NUMBER[] = {0x1B, 0xAD, 0xC0, 0xDE};
 enum class GlogCompressMode : uint8_t { None = 1, Zlib = 2 };
 enum class GlogEncryptMode : uint8_t { None = 1, AES = 2 };
 
+/**
+ * where a record is in its log, chunks of one log are written next to each other in order First, Middle..., Last
+ */
+enum class GlogChunkType : uint8_t { Whole = 0, First = 1, Middle = 2, Last = 3 };
+
+// mode set bits: chunk type (2) | compress mode (2) | encrypt mode (4)
 typedef struct ModeSet {
     GlogCompressMode m_compressMode = GlogCompressMode::None;
     GlogEncryptMode m_encryptMode = GlogEncryptMode::None;
+    GlogChunkType m_chunkType = GlogChunkType::Whole;
 } ModeSet;
 
 #pragma pack(push, 1)
@@ -105,16 +160,37 @@ typedef struct FixedHeader {
 
 const GlogByte_t HEADER_FIXED_LENGTH = sizeof(FixedHeader);
 
+// cache only, last CHECKPOINT_LENGTH bytes of mmap, logs are never written there.
+// archive is truncated to write position so it never has one. native byte order, cache never leaves device
+#pragma pack(push, 1)
+typedef struct Checkpoint {
+    uint32_t m_magic;
+    uint32_t m_fileSize;
+    uint32_t m_position; // write position after last committed record
+    uint32_t m_totalLogNum;
+    uint32_t m_totalLogSize;
+    uint32_t m_checksum; // of fields above
+} Checkpoint;
+#pragma pack(pop)
+
+const uint32_t CHECKPOINT_MAGIC = 0x54504347; // "GCPT"
+const GlogByte_t CHECKPOINT_LENGTH = sizeof(Checkpoint);
+
 // log length width = 2 bytes
 const GlogByte_t LOG_LENGTH_BYTES = 2;
 // sync marker
 const GlogByte_t SYNC_MARKER[] = {0xB7, 0xDB, 0xE7, 0xDB, 0x80, 0xAD, 0xD9, 0x57};
 const GlogByte_t SYNC_MARKER_LENGTH = sizeof(SYNC_MARKER);
+// sequence number width of GlogSequenceVersion = 8 bytes
+const GlogByte_t SEQUENCE_BYTES = 8;
 } // namespace format
 
 // single log content max length = 16 KB (uncompressed)
 // MUST < 2^16 - 1 = (64KB - 1) because length's width = 2 bytes
+// longer log is written as chunks, see GlogChunkVersion
 const GlogBufferLength_t SINGLE_LOG_CONTENT_MAX_LENGTH = 16 * 1024;
+// content length of a chunk, leaves room for compressor's bound so compressed chunk is still a legal record
+const GlogBufferLength_t LOG_CHUNK_LENGTH = SINGLE_LOG_CONTENT_MAX_LENGTH - 128;
 
 const uint8_t MAX_RECURSION_DEPTH = 5;
 
@@ -127,6 +203,26 @@ enum class SyncFlag : bool { Glog_SYNC = true, Glog_ASYNC = false };
 
 enum class Endianness : uint8_t { BigEndian = 0, LittleEndian = 1 };
 
+/**
+ * what async write does when pending log copies exceed memory budget
+ */
+enum class OverflowPolicy : uint8_t {
+    Block = 0,      // wait until worker frees enough memory or timeout, then drop the new log
+    DropNewest = 1, // drop the new log
+    DropOldest = 2, // drop the oldest logs still in queue before any flush to make room, drop newest if none
+    Sample = 3,     // keep 1 of every sample rate logs once half of budget is used, drop newest if still full
+};
+
+/**
+ * how mmap cache is written back to disk, logs in mmap survive a crash of the process in any case
+ */
+enum class SyncPolicy : uint8_t {
+    Full = 0,       // MS_SYNC the whole cache before it is archived
+    DirtyRange = 1, // MS_SYNC only the pages written since last msync before archive
+    Periodic = 2,   // MS_ASYNC pages written since last msync every sync interval and before archive
+    Never = 3,      // never msync, leave write back to the kernel
+};
+
 enum class FileOrder : uint8_t { None = 0, CreateTimeAscending = 1, CreateTimeDescending = 2 };
 
 const long FLUSH_AWAIT_TIMEOUT_MILLIS = 3000; // await flush at most 3s
@@ -143,6 +239,19 @@ typedef struct FileStat {
     size_t m_size;
 } FileStat;
 
+typedef struct GlogStatistics {
+    size_t m_bufferPoolHits;   // async log copies served by buffer pool
+    size_t m_bufferPoolMisses; // async log copies fall back to malloc
+    size_t m_droppedLogs;      // async logs dropped by overflow policy
+    size_t m_droppedBytes;
+    size_t m_standbySwitches; // full cache handed to background archive
+    size_t m_standbyMisses;   // cache full while standby still archiving, writer waited for it
+    size_t m_cacheSize;       // size of the next cache loaded, see GlogConfig::m_adaptiveCacheSize
+    size_t m_cacheResizes;
+    size_t m_msyncCalls; // of cache and archive mmap, see GlogConfig::m_syncPolicy
+    size_t m_msyncBytes;
+} GlogStatistics;
+
 typedef struct GlogConfig {
     std::string m_protoName;
     std::string m_rootDirectory;
@@ -153,6 +262,21 @@ typedef struct GlogConfig {
     format::GlogCompressMode m_compressMode = format::GlogCompressMode::Zlib;
     format::GlogEncryptMode m_encryptMode = format::GlogEncryptMode::None;
     std::string *m_serverPublicKey = nullptr;
+    size_t m_asyncMemoryBudget = DEFAULT_ASYNC_MEMORY_BUDGET; // max bytes of async logs waiting in queue
+    OverflowPolicy m_overflowPolicy = OverflowPolicy::Block;
+    long m_overflowBlockTimeoutMillis = DEFAULT_OVERFLOW_BLOCK_TIMEOUT_MILLIS; // for OverflowPolicy::Block
+    uint32_t m_overflowSampleRate = DEFAULT_OVERFLOW_SAMPLE_RATE;              // for OverflowPolicy::Sample
+    bool m_sharedWriter = false; // async instances share writer threads, see Glog::initialize
+    size_t m_cacheShardNum = DEFAULT_CACHE_SHARD_NUM; // sync mode only, > 1 writes to per thread cache shards
+    size_t m_cacheSize = 0; // mmap cache bytes, rounded up to page size, 0 for calculateRoundCacheSize()
+    bool m_adaptiveCacheSize = false; // grow or shrink cache between m_cacheSize and m_maxCacheSize at archive
+    size_t m_maxCacheSize = DEFAULT_MAX_ADAPTIVE_CACHE_SIZE; // for m_adaptiveCacheSize
+    bool m_standbyCache = false; // writers switch to a standby cache while the full one is archived in background
+    uint32_t m_cacheHighWaterPercent = DEFAULT_CACHE_HIGH_WATER_PERCENT; // for m_standbyCache, switch threshold
+    bool m_prefaultCache = false; // take page faults of a new cache when it is loaded, not on first write of each page
+    bool m_hugePageCache = false; // map cache with transparent huge pages where kernel and filesystem support them
+    SyncPolicy m_syncPolicy = SyncPolicy::Full;
+    long m_syncIntervalMillis = DEFAULT_SYNC_INTERVAL_MILLIS; // for SyncPolicy::Periodic
 } GlogConfig;
 } // namespace glog
 #endif //CORE__GLOGPREDEF_H_
@@ -10,75 +10,170 @@
 #include "InternalLog.h"
 #include "ZlibCompress.h"
 #include "utilities.h"
+#include <algorithm>
 #include <cerrno>
 #include <dirent.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <utility>
+#include <vector>
 
 namespace glog {
-GlogReader::GlogReader(string archiveFile, string protoName, const string *serverPrivateKey)
+GlogArchive::GlogArchive(string archiveFile, int fd, size_t size, size_t headerSize, ino_t inode)
     : m_file(std::move(archiveFile))
-    , m_fd(-1)
-    , m_size(0)
-    , m_protoName(std::move(protoName))
-    , m_decompressor(nullptr)
-    , m_position(0)
-    , m_loadFileCompleted(false) {
-    if (serverPrivateKey && !serverPrivateKey->empty()) {
-        if (serverPrivateKey->length() != ECC_PRIVATE_KEY_LEN * 2 || !str2Hex(*serverPrivateKey, m_serverPrivateKey)) {
-            throw std::invalid_argument("illegal svr pri key");
+    , m_size(size)
+    , m_headerSize(headerSize)
+    , m_fd(fd)
+    , m_ptr(nullptr)
+    , m_inode(inode) {
+    // archive is only appended or removed, mapping what's there now is safe. read by pread if fails to map
+    if (m_size > 0) {
+        void *ptr = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+        if (ptr == MAP_FAILED) {
+            InternalWarning("fail to mmap [%s], %s, read by pread", m_file.c_str(), strerror(errno));
+        } else {
+            m_ptr = static_cast<uint8_t *>(ptr);
+            if (::madvise(m_ptr, m_size, MADV_SEQUENTIAL) != 0) {
+                InternalDebug("fail to madvise [%s], %s", m_file.c_str(), strerror(errno));
+            }
         }
-        m_cipherReady = true;
     }
-    m_loadFileCompleted = openFile();
 }
 
-GlogReader::~GlogReader() {
-    closeFile();
-    delete m_decompressor;
+GlogArchive::~GlogArchive() {
+    if (m_ptr && ::munmap(m_ptr, m_size) != 0) {
+        InternalError("fail to munmap [%s], %s", m_file.c_str(), strerror(errno));
+    }
+    if (::close(m_fd) != 0) {
+        InternalError("fail to close [%s], %s", m_file.c_str(), strerror(errno));
+    }
 }
 
-bool GlogReader::openFile() {
-    m_fd = ::open(m_file.c_str(), O_RDONLY | O_CLOEXEC, S_IRWXU);
-    if (m_fd < 0) {
-        InternalError("fail to open [%s], %s", m_file.c_str(), strerror(errno));
-        return false;
+std::shared_ptr<GlogArchive> GlogArchive::open(const string &archiveFile, const string &protoName) {
+    int fd = ::open(archiveFile.c_str(), O_RDONLY | O_CLOEXEC, S_IRWXU);
+    if (fd < 0) {
+        InternalError("fail to open [%s], %s", archiveFile.c_str(), strerror(errno));
+        return nullptr;
     }
-
-    getFileSize(m_fd, m_size);
+    struct stat st = {};
+    if (::fstat(fd, &st) != 0) {
+        InternalError("fail to fstat [%s], %s", archiveFile.c_str(), strerror(errno));
+        ::close(fd);
+        return nullptr;
+    }
+    auto size = static_cast<size_t>(st.st_size);
 
     size_t headerSize = 0;
-    HeaderMismatchReason reason = readHeader(m_fd, m_file, m_size, m_protoName, &headerSize, nullptr);
+    HeaderMismatchReason reason = readHeader(fd, archiveFile, size, protoName, &headerSize, nullptr);
 
     if (reason != HeaderMismatchReason::None) {
-        int ret = ::remove(m_file.c_str());
-        InternalDebug("file [%s] header mismatch reason:%d, remove ret:%d %s", m_file.c_str(), reason, ret,
+        ::close(fd);
+        int ret = ::remove(archiveFile.c_str());
+        InternalDebug("file [%s] header mismatch reason:%d, remove ret:%d %s", archiveFile.c_str(), reason, ret,
                       ::strerror(errno));
+        return nullptr;
+    }
+    return std::shared_ptr<GlogArchive>(new GlogArchive(archiveFile, fd, size, headerSize, st.st_ino));
+}
+
+bool GlogArchive::readAt(void *dst, size_t size, size_t position) const {
+    if (position + size > m_size) {
         return false;
     }
-    m_decompressor = new ZlibDecompressor();
-    m_position = headerSize;
-    return true;
+    if (m_ptr) {
+        ::memcpy(dst, m_ptr + position, size);
+        return true;
+    }
+    return ::pread(m_fd, dst, size, static_cast<off_t>(position)) == static_cast<ssize_t>(size);
 }
 
-void GlogReader::closeFile() {
-    if (m_fd >= 0) {
-        if (::close(m_fd) != 0) {
-            InternalError("fail to close [%s], %s", m_file.c_str(), strerror(errno));
+int64_t GlogArchive::searchSyncMarker(size_t position) const {
+    if (!m_ptr) {
+        return searchSyncMarkerInFile(m_file, m_fd, static_cast<off_t>(position), m_size);
+    }
+    if (position >= m_size) {
+        return -1;
+    }
+    int64_t found = findSyncMarker(m_ptr + position, m_size - position);
+    return found < 0 ? -1 : static_cast<int64_t>(position) + found;
+}
+
+static const size_t BACKWARD_SEARCH_BLOCK_SIZE = 64 * 1024;
+
+int64_t GlogArchive::searchSyncMarkerBackward(size_t begin, size_t end) const {
+    if (end > m_size || begin >= end || end - begin < format::SYNC_MARKER_LENGTH) {
+        return -1;
+    }
+    if (m_ptr) {
+        int64_t found = searchNeedle(m_ptr + begin, static_cast<int64_t>(end - begin), format::SYNC_MARKER,
+                                     format::SYNC_MARKER_LENGTH, true);
+        return found < 0 ? -1 : static_cast<int64_t>(begin) + found;
+    }
+    // blocks from the end, overlap by marker length - 1 bytes
+    std::vector<uint8_t> block(std::min(BACKWARD_SEARCH_BLOCK_SIZE, end - begin));
+    size_t blockEnd = end;
+    while (blockEnd - begin >= format::SYNC_MARKER_LENGTH) {
+        const size_t blockBegin = blockEnd - std::min(block.size(), blockEnd - begin);
+        if (!readAt(block.data(), blockEnd - blockBegin, blockBegin)) {
+            InternalError("fail to read file [%s], %s", m_file.c_str(), strerror(errno));
+            return -1;
+        }
+        int64_t found = searchNeedle(block.data(), static_cast<int64_t>(blockEnd - blockBegin), format::SYNC_MARKER,
+                                     format::SYNC_MARKER_LENGTH, true);
+        if (found >= 0) {
+            return static_cast<int64_t>(blockBegin) + found;
+        }
+        if (blockBegin == begin) {
+            break;
+        }
+        blockEnd = blockBegin + format::SYNC_MARKER_LENGTH - 1;
+    }
+    return -1;
+}
+
+bool GlogArchive::isUpToDate() const {
+    struct stat st = {};
+    return ::stat(m_file.c_str(), &st) == 0 && st.st_ino == m_inode && static_cast<size_t>(st.st_size) == m_size;
+}
+
+GlogReader::GlogReader(string archiveFile, std::shared_ptr<GlogArchive> archive, const string *serverPrivateKey)
+    : m_file(std::move(archiveFile))
+    , m_archive(std::move(archive))
+    , m_position(0)
+    , m_loadFileCompleted(false)
+    , m_decompressor(nullptr)
+    , m_chunkBuffer(nullptr) {
+    if (serverPrivateKey && !serverPrivateKey->empty()) {
+        if (serverPrivateKey->length() != ECC_PRIVATE_KEY_LEN * 2 || !str2Hex(*serverPrivateKey, m_serverPrivateKey)) {
+            throw std::invalid_argument("illegal svr pri key");
         }
+        m_cipherReady = true;
     }
-    m_fd = -1;
-    m_size = 0;
-    m_position = 0;
+    if (m_archive) {
+        m_decompressor = new ZlibDecompressor();
+        m_position = m_archive->m_headerSize;
+        m_loadFileCompleted = true;
+    }
+}
+
+GlogReader::~GlogReader() {
+    delete m_decompressor;
+    delete m_backwardDecompressor;
+    delete m_chunkBuffer;
+    delete m_recordBuffer;
 }
 
 bool GlogReader::seek(size_t position) {
-    if (::lseek(m_fd, position, SEEK_SET) < 0) {
-        InternalError("fail to lseek file [%s], %s", m_file.c_str(), strerror(errno));
+    // reader holds its own position, no file offset is shared with other readers
+    if (!m_archive) {
+        InternalError("fail to seek file [%s], not open", m_file.c_str());
         return false;
     }
     m_position = position;
+    // chunks at new position are not the rest of long log before it, reverse cursor is left as it is
+    m_pendingLog.clear();
+    m_inChunkedLog = false;
     return true;
 }
 
@@ -7,7 +7,9 @@
 
 #include "GlogBuffer.h"
 #include "GlogPredef.h"
+#include "openssl/openssl_aes.h"
 #include <cerrno>
+#include <memory>
 #include <string>
 #include <unistd.h>
 #include <vector>
@@ -17,6 +19,44 @@ using namespace std;
 namespace glog {
 class Decompressor;
 
+/**
+ * archive opened once and shared by all readers of it. it's never changed after open, readers keep their own
+ * position and read by mmap or pread, so readers on different threads scan it at the same time.
+ */
+class GlogArchive {
+public:
+    const string m_file;
+    const size_t m_size;        // size at open, bytes appended later are not seen
+    const size_t m_headerSize;
+
+    // nullptr if file fails to open or header mismatches
+    static std::shared_ptr<GlogArchive> open(const string &archiveFile, const string &protoName);
+
+    ~GlogArchive();
+
+    // copy [position, position + size) of archive
+    bool readAt(void *dst, size_t size, size_t position) const;
+
+    // archive mapped read-only, records are parsed in place. nullptr if read by pread
+    const uint8_t *mapped() const { return m_ptr; }
+
+    // absolute position of first sync marker since position, -1 if not found
+    int64_t searchSyncMarker(size_t position) const;
+
+    // absolute position of last sync marker in [begin, end), -1 if not found
+    int64_t searchSyncMarkerBackward(size_t begin, size_t end) const;
+
+    // same file and size as what's on disk now
+    bool isUpToDate() const;
+
+private:
+    int m_fd;
+    uint8_t *m_ptr;
+    ino_t m_inode;
+
+    GlogArchive(string archiveFile, int fd, size_t size, size_t headerSize, ino_t inode);
+};
+
 class GlogReader {
     friend class Glog;
 
@@ -27,34 +67,134 @@ public:
 
     size_t getPosition() const { return m_position; }
 
+    /**
+     * read next log, chunks of a long log are put together. return log length, 0 if broken bytes are skipped
+     * (just read again), < 0 if no more log or fail. log longer than capacity is skipped with -11.
+     */
+    int read(void *outBuffer, size_t capacity);
+
     int read(GlogBuffer &outBuffer);
 
+    /**
+     * read as many whole logs as fit in arena, log i is at arena + offsets[i] with lengths[i] bytes.
+     * log which doesn't fit in the rest of arena comes first in next call, log longer than the whole arena
+     * is skipped. return number of logs, < 0 the same as read if no log is read.
+     */
+    int readBatch(void *arena, size_t capacity, uint32_t *offsets, uint32_t *lengths, size_t maxLogs);
+
+    /**
+     * streaming read, long log comes out chunk by chunk without being put together, outBuffer holding
+     * SINGLE_LOG_CONTENT_MAX_LENGTH is always enough. chunk type is First, Middle..., Last for long log
+     * and Whole for the others, First or Whole before Last means the rest of the long log is broken.
+     * chunks whose First is lost are skipped. return the same as read.
+     */
+    int readChunk(GlogBuffer &outBuffer, format::GlogChunkType &outChunkType);
+
+    /**
+     * reverse cursor, read logs from the newest to the oldest, independent of read and seek. record boundaries
+     * are found by sync markers from the end of archive, time is proportional to what's read if every record can
+     * be decoded alone, e.g. uncompressed or cache shards. records of a zlib stream are decoded from start of the
+     * stream, which is found by stepping back record by record. return the same as read.
+     */
+    int readBackward(void *outBuffer, size_t capacity);
+
+    int readBackward(GlogBuffer &outBuffer);
+
 private:
     string m_file;
-    int m_fd;
-    size_t m_size;
+    std::shared_ptr<GlogArchive> m_archive; // nullptr if fails to open
     size_t m_position;
-    string m_protoName;
     bool m_loadFileCompleted;
     Decompressor *m_decompressor;
     uint8_t m_serverPrivateKey[ECC_PRIVATE_KEY_LEN] = {};
     bool m_cipherReady = false;
-
-    GlogReader(string archiveFile, string protoName, const string *serverPrivateKey);
+    bool m_inChunkedLog = false; // First chunk is read, Last is not
+    GlogBuffer *m_chunkBuffer;   // chunk which doesn't fit in what's left of caller's buffer
+    GlogBuffer *m_recordBuffer = nullptr; // compressed record to be decrypted, or read by pread
+    vector<uint8_t> m_pendingLog;         // log which didn't fit in what's left of last batch arena
+
+    // reverse cursor, records before m_backwardEnd are not read yet
+    struct BackwardRecord {
+        format::GlogChunkType m_chunkType;
+        size_t m_position; // in archive
+        size_t m_offset;   // in m_backwardData
+        size_t m_length;
+    };
+    bool m_backwardStarted = false;
+    size_t m_backwardEnd = 0;
+    size_t m_backwardStreamStart = 0; // newest record found to start a fresh zlib stream, 0 if none
+    size_t m_backwardRecoverFrom = SIZE_MAX; // broken bytes after it are skipped when decoding from stream start
+    bool m_readingBackward = false; // decoding backward without forward recovery
+    Decompressor *m_backwardDecompressor = nullptr;
+    vector<uint8_t> m_backwardData;
+    vector<BackwardRecord> m_backwardRecords; // decoded but not returned, the newest is the last
+    vector<vector<uint8_t>> m_backwardChunks; // chunks of long log read so far, from Last on
+
+    // client public key only changes when cache is reloaded, records between share the same AES key
+    static constexpr size_t AES_KEY_CACHE_SIZE = 4;
+    struct AesKeyCacheEntry {
+        uint8_t m_clientPublicKey[ECC_PUBLIC_KEY_LEN] = {};
+        openssl::AES_KEY m_aesKey = {};
+        bool m_valid = false;
+    };
+    AesKeyCacheEntry m_aesKeyCache[AES_KEY_CACHE_SIZE];
+    size_t m_lastAesKeyIndex = 0;
+
+    GlogReader(string archiveFile, std::shared_ptr<GlogArchive> archive, const string *serverPrivateKey);
 
     ~GlogReader();
 
-    bool openFile();
+    // copy [m_position, m_position + size) of archive, m_position is not moved
+    bool readBytes(void *dst, size_t size) { return m_archive->readAt(dst, size, m_position); }
+
+    int64_t searchSyncMarker(size_t position) { return m_archive->searchSyncMarker(position); }
+
+    /**
+     * read one log, chunks of a long log are put together. log longer than capacity is moved to spill if not
+     * nullptr, or skipped, -11 is returned either way.
+     */
+    int readLog(uint8_t *outPtr, size_t capacity, vector<uint8_t> *spill);
+
+    int takePendingLog(uint8_t *outPtr, size_t capacity);
+
+    // read and decode one record, chunk or not
+    int readRecord(GlogBuffer &outBuffer, format::GlogChunkType &outChunkType, Decompressor *decompressor);
+
+    /**
+     * decode the record before m_backwardEnd, or records from start of its zlib stream if it depends on them.
+     * return number of records decoded, 0 if broken bytes are skipped, < 0 if no more record
+     */
+    int decodeBackward();
+
+    // decode record at begin with a fresh decompressor, return the same as readRecord
+    int decodeOne(size_t begin);
+
+    void prepareBackwardDecode();
+
+    // decode records from begin to m_backwardEnd with a fresh decompressor, skip broken bytes from recoverFrom on
+    int decodeRange(size_t begin, size_t recoverFrom);
+
+    // keep at least the newest keep bytes of decoded records
+    void dropOldestDecoded(size_t keep);
+
+    // start of record ending at end, -1 if bytes before end are not a whole record
+    int64_t findRecordStart(size_t end);
+
+    bool isRecordAt(size_t start, size_t end);
 
-    void closeFile();
+    /**
+     * AES key of records written with client public key, derived by ECDH on cache miss.
+     * return 0 if ok, -1 if ECDH fails, -2 if AES key fails to expand
+     */
+    int aesKeyFor(const uint8_t *clientPublicKey, const openssl::AES_KEY *&outAesKey);
 
-    bool isFileAlreadyOpen() const { return m_fd >= 0 && m_size > 0; }
+    bool isFileAlreadyOpen() const { return m_archive && m_archive->m_size > 0; }
 
     size_t spaceRemain() const {
-        if (m_size <= m_position) {
+        if (m_archive->m_size <= m_position) {
             return 0;
         }
-        return m_size - m_position;
+        return m_archive->m_size - m_position;
     }
 };
 } // namespace glog
@@ -13,10 +13,13 @@
 #include "GlogReader.h"
 #include "MessageQueue.h"
 #include "ScopedLock.h"
+#include "ZlibCompress.h"
 #include "aes/AESCrypt.h"
 #include "micro-ecc/uECC.h"
 #include "utilities.h"
 #include <cerrno>
+#include <cstddef>
+#include <vector>
 
 using namespace glog::format;
 /*
@@ -74,6 +77,18 @@ using namespace glog::format;
 +-----------------------------------------------------------------+
 |                              ...
 +-----------------------------------------------------------------+
+*
+* mode set: chunk type (2 bits) | compress mode (2 bits) | encrypt mode (4 bits).
+* since GlogChunkVersion a log longer than SINGLE_LOG_CONTENT_MAX_LENGTH is cut into pieces of LOG_CHUNK_LENGTH,
+* each piece is a record as above (compressed and encrypted alone) with chunk type First, Middle... or Last,
+* chunks of one log are always written next to each other. single record log has chunk type Whole (0),
+* so a GlogCipherVersion file reads the same.
+*
+* cache shard (version GlogSequenceVersion) stores a sequence number (8) right after mode set of each log,
+* logs of all shards are merged by sequence number into the cache file without it, so archives never contain it.
+*
+* cache (and cache shard) keeps a Checkpoint of write position in its last CHECKPOINT_LENGTH bytes, updated by every
+* committed record. it is trusted on load if it validates, or every record is walked as before.
 */
 
 namespace glog {
@@ -92,7 +107,8 @@ HeaderMismatchReason readHeader(int fd,
                                 size_t fileSize,
                                 const string &protoName,
                                 size_t *outHeaderSize,
-                                GlogByte_t *outVersionCode) {
+                                GlogByte_t *outVersionCode,
+                                GlogVersion versionCode) {
     InternalDebug("start read file's [%s] header", path.c_str());
     if (fileSize < HEADER_FIXED_LENGTH) {
         InternalDebug("invalid file [%s], too small size:%zu", path.c_str(), fileSize);
@@ -111,7 +127,10 @@ HeaderMismatchReason readHeader(int fd,
     if (outVersionCode) {
         *outVersionCode = fixedHeader.m_versionCode;
     }
-    if (fixedHeader.m_versionCode != static_cast<GlogByte_t>(GlogVersion::GlogCipherVersion)) {
+    // GlogCipherVersion file is a GlogChunkVersion file without chunks
+    const bool compatible = versionCode == GlogVersion::GlogChunkVersion &&
+                            fixedHeader.m_versionCode == static_cast<GlogByte_t>(GlogVersion::GlogCipherVersion);
+    if (fixedHeader.m_versionCode != static_cast<GlogByte_t>(versionCode) && !compatible) {
         InternalDebug("invalid file [%s], version code [%d] mismatching", path.c_str(), fixedHeader.m_versionCode);
         return HeaderMismatchReason::VersionCodeMismatch;
     }
@@ -149,36 +168,399 @@ HeaderMismatchReason readHeader(int fd,
     return HeaderMismatchReason::None;
 }
 
+bool upgradeVersionCode(int fd, const string &path, GlogVersion versionCode) {
+    auto code = static_cast<GlogByte_t>(versionCode);
+    if (::pwrite(fd, &code, sizeof(code), offsetof(FixedHeader, m_versionCode)) != sizeof(code)) {
+        InternalError("fail to upgrade version code of [%s], %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool Glog::write(const void *data, size_t length) {
+    if (length <= SINGLE_LOG_CONTENT_MAX_LENGTH) {
+        return write(GlogBuffer(const_cast<void *>(data), static_cast<GlogBufferLength_t>(length)));
+    }
+    // every cache becomes an archive of its own without incremental archive, all chunks of a log go in one cache.
+    // rough check before taking async budget, exact one is done by cache file
+    if (unlikely(!m_incrementalArchive && length > m_cacheSize)) {
+        InternalWarning("log length [%zu] exceeds cache size [%zu], skip write", length, m_cacheSize.load());
+        return false;
+    }
+    return m_async ? enqueueChunkedLog(data, length) : writeLargeSync(data, length);
+}
+
 bool Glog::writeAsync(const GlogBuffer &log) {
     GlogBufferLength_t length = log.getAvailLength();
     if (unlikely(length == 0 || length > SINGLE_LOG_CONTENT_MAX_LENGTH)) {
         InternalWarning("illegal log length [%d], skip write", length);
         return false;
     }
+    return enqueueAsyncLog(log.getPtr(), length);
+}
+
+bool Glog::enqueueAsyncLog(const void *data, size_t length) {
+    if (!acquireAsyncBudget(length)) {
+        m_droppedLogs++;
+        m_droppedBytes += length;
+        return false;
+    }
 
     // make a copy in case of content in log's pointer address change before action executed
-    auto *copy = new GlogBuffer(log.getPtr(), log.getAvailLength(), true);
-    bool enqueued = m_writeQueue->enqueue(Message([this, copy]() {
-        writeSync(*copy);
-        delete copy;
-    }));
+    void *copy = m_bufferPool->acquire(length);
+    if (!copy) {
+        InternalError("fail to copy log, size:%zu", length);
+        m_pendingAsyncBytes -= length;
+        return false;
+    }
+    ::memcpy(copy, data, length);
+    // copy will be written and released by worker in batch
+    bool enqueued = m_writeQueue->enqueue(Message(copy, length));
+    if (!enqueued) {
+        releaseAsyncLog(copy, length);
+    }
     return enqueued;
 }
 
-bool Glog::writeSync(const GlogBuffer &log) {
-    SCOPED_LOCK(m_syncWriteLock);
+bool Glog::enqueueChunkedLog(const void *data, size_t length) {
+    size_t chunkNum = (length + LOG_CHUNK_LENGTH - 1) / LOG_CHUNK_LENGTH;
+    if (unlikely(chunkNum > MESSAGE_QUEUE_CAPACITY)) {
+        InternalWarning("log length [%zu] exceeds async queue capacity, skip write", length);
+        return false;
+    }
+    if (!acquireAsyncBudget(length)) {
+        m_droppedLogs++;
+        m_droppedBytes += length;
+        return false;
+    }
+
+    // one pooled slot per chunk instead of one big block, the worker releases each after it's written
+    const auto *ptr = static_cast<const uint8_t *>(data);
+    std::vector<struct iovec> copies;
+    copies.reserve(chunkNum);
+    for (size_t offset = 0; offset < length; offset += LOG_CHUNK_LENGTH) {
+        size_t chunkLength = std::min(length - offset, (size_t) LOG_CHUNK_LENGTH);
+        void *copy = m_bufferPool->acquire(chunkLength);
+        if (!copy) {
+            InternalError("fail to copy log chunk, size:%zu", chunkLength);
+            for (const struct iovec &chunk : copies) {
+                releaseAsyncLog(chunk.iov_base, chunk.iov_len);
+            }
+            m_pendingAsyncBytes -= length - offset;
+            return false;
+        }
+        ::memcpy(copy, ptr + offset, chunkLength);
+        copies.push_back({.iov_base = copy, .iov_len = chunkLength});
+    }
+    std::vector<Message> chunks;
+    chunks.reserve(chunkNum);
+    for (size_t i = 0; i < chunkNum; ++i) {
+        GlogChunkType chunkType = GlogChunkType::Middle;
+        if (i == 0) {
+            chunkType = GlogChunkType::First;
+        } else if (i + 1 == chunkNum) {
+            chunkType = GlogChunkType::Last;
+        }
+        chunks.emplace_back(copies[i].iov_base, copies[i].iov_len, chunkType, length);
+    }
+    bool enqueued = m_writeQueue->enqueueBulk(chunks.data(), chunks.size());
+    if (!enqueued) {
+        for (const struct iovec &chunk : copies) {
+            releaseAsyncLog(chunk.iov_base, chunk.iov_len);
+        }
+    }
+    return enqueued;
+}
+
+bool Glog::writeBatch(const struct iovec *logs, size_t num) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < num; ++i) {
+        if (unlikely(logs[i].iov_len == 0 || logs[i].iov_len > SINGLE_LOG_CONTENT_MAX_LENGTH)) {
+            InternalWarning("illegal log length [%zu] at index [%zu], skip write batch", logs[i].iov_len, i);
+            return false;
+        }
+        bytes += logs[i].iov_len;
+    }
+    if (num == 0) {
+        return true;
+    }
+    return m_async ? writeBatchAsync(logs, num, bytes) : writeSyncBatch(logs, num);
+}
+
+bool Glog::writeBatchAsync(const struct iovec *logs, size_t num, size_t bytes) {
+    if (!acquireAsyncBudget(bytes)) {
+        m_droppedLogs += num;
+        m_droppedBytes += bytes;
+        return false;
+    }
+
+    // copy the whole batch into one block: iovec array + contents, worker writes it as one message
+    auto *block = static_cast<struct iovec *>(m_bufferPool->acquire(num * sizeof(struct iovec) + bytes));
+    if (!block) {
+        InternalError("fail to copy logs, num:%zu, size:%zu", num, bytes);
+        m_pendingAsyncBytes -= bytes;
+        return false;
+    }
+    auto *content = reinterpret_cast<uint8_t *>(block + num);
+    for (size_t i = 0; i < num; ++i) {
+        ::memcpy(content, logs[i].iov_base, logs[i].iov_len);
+        block[i].iov_base = content;
+        block[i].iov_len = logs[i].iov_len;
+        content += logs[i].iov_len;
+    }
+    bool enqueued = m_writeQueue->enqueue(Message(block, num, bytes));
+    if (!enqueued) {
+        releaseAsyncLog(block, bytes);
+    }
+    return enqueued;
+}
+
+bool Glog::tryAcquireAsyncBudget(size_t length) {
+    size_t pending = m_pendingAsyncBytes.load();
+    do {
+        // always accept one log, or a log larger than budget never get a chance
+        if (pending > 0 && pending + length > m_asyncMemoryBudget) {
+            return false;
+        }
+    } while (!m_pendingAsyncBytes.compare_exchange_weak(pending, pending + length));
+    return true;
+}
+
+bool Glog::acquireAsyncBudget(size_t length) {
+    switch (m_overflowPolicy) {
+        case OverflowPolicy::Block: {
+            if (tryAcquireAsyncBudget(length)) {
+                return true;
+            }
+            int64_t deadline = cycleClockNow() + m_overflowBlockTimeoutMillis * 1000;
+            SCOPED_LOCK(m_budgetLock);
+
+            m_budgetWaiters++;
+            bool acquired;
+            while (true) {
+                // pairs with the fence in releaseAsyncLog(), either we see the budget or worker sees us waiting
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if ((acquired = tryAcquireAsyncBudget(length))) {
+                    break;
+                }
+                long remainMillis = static_cast<long>((deadline - cycleClockNow()) / 1000);
+                if (remainMillis <= 0 || !m_budgetCondition->awaitTimeout(*m_budgetLock, remainMillis)) {
+                    acquired = tryAcquireAsyncBudget(length);
+                    break;
+                }
+            }
+            m_budgetWaiters--;
+            return acquired;
+        }
+        case OverflowPolicy::DropNewest:
+            return tryAcquireAsyncBudget(length);
+        case OverflowPolicy::DropOldest: {
+            if (tryAcquireAsyncBudget(length)) {
+                return true;
+            }
+            m_writeQueue->dropOldest(length, [this](void *block, size_t num, size_t bytes) {
+                m_droppedLogs += num;
+                m_droppedBytes += bytes;
+                releaseAsyncLog(block, bytes);
+            });
+            // logs already taken by worker or behind a control message can't be dropped, give up the new one then
+            return tryAcquireAsyncBudget(length);
+        }
+        case OverflowPolicy::Sample: {
+            if (m_pendingAsyncBytes.load() + length > m_asyncMemoryBudget / 2 &&
+                m_sampleCounter++ % m_overflowSampleRate != 0) {
+                return false;
+            }
+            return tryAcquireAsyncBudget(length);
+        }
+    }
+    return tryAcquireAsyncBudget(length);
+}
+
+void Glog::releaseAsyncLog(void *block, size_t bytes) {
+    m_bufferPool->release(block);
+    m_pendingAsyncBytes -= bytes;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_budgetWaiters.load() > 0) {
+        SCOPED_LOCK(m_budgetLock);
+        m_budgetCondition->broadcast();
+    }
+}
 
+bool Glog::writeSync(const GlogBuffer &log) {
     GlogBufferLength_t length = log.getAvailLength();
     if (unlikely(length == 0 || length > SINGLE_LOG_CONTENT_MAX_LENGTH)) {
         InternalWarning("illegal log length [%d], skip write", length);
         return false;
     }
+    if (!m_shards.empty()) {
+        struct iovec single = {.iov_base = log.getPtr(), .iov_len = length};
+        return writeShard(&single, 1);
+    }
+
+    SCOPED_LOCK(m_syncWriteLock);
+
+    if (m_shouldTryFlushAcrossDay && m_incrementalArchive) {
+        tryFlushAcrossDay();
+    }
+
+    bool ret = m_cacheFile->writeLogData(log, [this](GlogBufferLength_t length) { return switchCacheFile(); });
+    maybeSwitchCacheFile();
+    return ret;
+}
+
+void *Glog::reserve(GlogBufferLength_t length) {
+    if (m_async || m_compressMode != format::GlogCompressMode::None ||
+        m_encryptMode != format::GlogEncryptMode::None || !m_shards.empty()) {
+        InternalWarning("reserve only supports sync glog without compression, encryption and cache shards");
+        return nullptr;
+    }
+    if (unlikely(length == 0 || length > SINGLE_LOG_CONTENT_MAX_LENGTH)) {
+        InternalWarning("illegal log length [%d], skip reserve", length);
+        return nullptr;
+    }
+
+    // released in commit
+    m_syncWriteLock->lock();
+
+    if (m_shouldTryFlushAcrossDay && m_incrementalArchive) {
+        tryFlushAcrossDay();
+    }
+
+    void *ptr = m_cacheFile->reserveLogData(length, [this](GlogBufferLength_t length) { return switchCacheFile(); });
+    if (!ptr) {
+        m_syncWriteLock->unlock();
+        return nullptr;
+    }
+    m_reserveThread = ::pthread_self();
+    m_reserving = true;
+    return ptr;
+}
+
+bool Glog::commit(GlogBufferLength_t length) {
+    if (!m_reserving || !::pthread_equal(m_reserveThread, ::pthread_self())) {
+        InternalWarning("commit without reserve on current thread");
+        return false;
+    }
+    m_reserving = false;
+    bool ret = m_cacheFile->commitLogData(length);
+    maybeSwitchCacheFile();
+    m_syncWriteLock->unlock();
+    return ret;
+}
+
+bool Glog::writeLargeSync(const void *data, size_t length) {
+    SCOPED_LOCK(m_syncWriteLock);
 
     if (m_shouldTryFlushAcrossDay && m_incrementalArchive) {
         tryFlushAcrossDay();
     }
+    // chunks bypass cache shards, logs written to shards before go to cache file first
+    if (!mergeShards()) {
+        InternalWarning("fail to merge some logs of cache shards");
+    }
 
-    return m_cacheFile->writeLogData(log, [this](GlogBufferLength_t length) { return internalFlush(); });
+    bool ret = m_cacheFile->writeLargeLogData(
+        data, length, [this](uint32_t length) { return switchCacheFile(); }, !m_incrementalArchive);
+    maybeSwitchCacheFile();
+    return ret;
+}
+
+bool Glog::writeQueuedChunk(const void *chunk, size_t length, GlogChunkType chunkType, size_t logLength) {
+    SCOPED_LOCK(m_syncWriteLock);
+
+    if (chunkType == GlogChunkType::First) {
+        m_skipChunks = false;
+        if (m_shouldTryFlushAcrossDay && m_incrementalArchive) {
+            tryFlushAcrossDay();
+        }
+        if (!mergeShards()) {
+            InternalWarning("fail to merge some logs of cache shards");
+        }
+        if (!m_incrementalArchive &&
+            !m_cacheFile->makeRoomForChunks(logLength, [this](uint32_t length) { return switchCacheFile(); })) {
+            m_skipChunks = true;
+        }
+    }
+    if (m_skipChunks) {
+        return false;
+    }
+
+    GlogBuffer data(const_cast<void *>(chunk), static_cast<GlogBufferLength_t>(length));
+    bool ret = m_cacheFile->writeChunkData(data, chunkType, [this](uint32_t length) { return switchCacheFile(); });
+    // a failed chunk makes the rest orphans, reader skips chunks whose first one is lost
+    m_skipChunks = !ret && chunkType != GlogChunkType::Last;
+    if (!m_incrementalArchive && chunkType != GlogChunkType::Last) {
+        return ret;
+    }
+    maybeSwitchCacheFile();
+    return ret;
+}
+
+bool Glog::writeSyncBatch(const struct iovec *logs, size_t num) {
+    if (!m_shards.empty()) {
+        return writeShard(logs, num);
+    }
+
+    SCOPED_LOCK(m_syncWriteLock);
+
+    if (m_shouldTryFlushAcrossDay && m_incrementalArchive) {
+        tryFlushAcrossDay();
+    }
+
+    bool ret = m_cacheFile->writeLogBatch(logs, num, [this](GlogBufferLength_t length) { return switchCacheFile(); });
+    maybeSwitchCacheFile();
+    return ret;
+}
+
+bool Glog::writeShard(const struct iovec *logs, size_t num) {
+    if (m_shouldTryFlushAcrossDay && m_incrementalArchive) {
+        SCOPED_LOCK(m_syncWriteLock);
+
+        tryFlushAcrossDay();
+    }
+    // spread threads over shards by the order they first write
+    static atomic_size_t nextThreadSlot(0);
+    static thread_local size_t threadSlot = nextThreadSlot++;
+    CacheShard &shard = m_shards[threadSlot % m_shards.size()];
+
+    bool ret = true;
+    size_t i = 0;
+    while (i < num) {
+        bool full = false;
+        {
+            SCOPED_LOCK(shard.m_lock);
+
+            // shard lock can't be held while merging, just mark it
+            auto onFull = [&full](uint32_t length) {
+                full = true;
+                return false;
+            };
+            for (; i < num; ++i) {
+                GlogBuffer data(logs[i].iov_base, static_cast<GlogBufferLength_t>(logs[i].iov_len));
+                bool written = shard.m_file->writeLogData(data, onFull);
+                if (full) {
+                    break;
+                }
+                ret &= written;
+            }
+        }
+        if (!full) {
+            break;
+        }
+        SCOPED_LOCK(m_syncWriteLock);
+
+        // write the log into emptied shard before other writers fill it again
+        bool merged = mergeShards([&]() {
+            GlogBuffer data(logs[i].iov_base, static_cast<GlogBufferLength_t>(logs[i].iov_len));
+            ret &= shard.m_file->writeLogData(data, nullptr);
+        });
+        if (!merged) {
+            InternalWarning("fail to merge some logs of cache shards");
+        }
+        i++;
+    }
+    return ret;
 }
 
 bool GlogFile::writeHeader() {
@@ -191,7 +573,7 @@ bool GlogFile::writeHeader() {
         InternalError("file left space [%d] not enough for header", spaceLeft());
         return false;
     }
-    FixedHeader fixedHeader{.m_versionCode = static_cast<GlogByte_t>(GlogVersion::GlogCipherVersion),
+    FixedHeader fixedHeader{.m_versionCode = static_cast<GlogByte_t>(versionCode()),
                             .m_protoNameLength = toLittleEndianU16(m_protoName.size())};
     memcpy(fixedHeader.m_magicNumber, MAGIC_NUMBER, sizeof(MAGIC_NUMBER));
 
@@ -232,8 +614,17 @@ void GlogFile::calculatePosition() {
     basePtr += m_headerSize;
     m_position += m_headerSize;
 
+    // logs of an older version may reach checkpoint
+    auto bytesLeft = [this]() -> size_t { return m_size <= m_position ? 0 : m_size - m_position; };
+    size_t recordBegin;
+
     // calculate total log size
-    while (spaceLeft() > LOG_LENGTH_BYTES + 1 + SYNC_MARKER_LENGTH) {
+    while (true) {
+        // stop at the end of last whole record, writes go on from there
+        recordBegin = m_position;
+        if (bytesLeft() <= LOG_LENGTH_BYTES + 1 + SYNC_MARKER_LENGTH) {
+            break;
+        }
         ModeSet ms = toModeSet(*basePtr);
         if (ms.m_compressMode < GlogCompressMode::None || ms.m_compressMode > GlogCompressMode::Zlib ||
             ms.m_encryptMode < format::GlogEncryptMode::None || ms.m_encryptMode > format::GlogEncryptMode::AES) {
@@ -242,10 +633,10 @@ void GlogFile::calculatePosition() {
             __TRY_RECOVER_CAL(1);
         }
         const bool cipher = ms.m_encryptMode == format::GlogEncryptMode::AES;
-        if (spaceLeft() < logStoreSize(1, cipher)) {
+        if (bytesLeft() < recordStoreSize(1, cipher)) {
             break;
         }
-        size_t offset = 1 + (cipher ? AES_KEY_LEN + ECC_PUBLIC_KEY_LEN : 0);
+        size_t offset = recordHeaderSize(cipher) - LOG_LENGTH_BYTES;
         basePtr += offset;
         m_position += offset;
 
@@ -262,7 +653,7 @@ void GlogFile::calculatePosition() {
         basePtr += offset;
         m_position += offset;
 
-        if (SYNC_MARKER_LENGTH > spaceLeft()) {
+        if (SYNC_MARKER_LENGTH > bytesLeft()) {
             InternalWarning("file [%s] end unexpectedly", m_path.c_str());
             break;
         }
@@ -272,14 +663,81 @@ void GlogFile::calculatePosition() {
             __TRY_RECOVER_CAL(SYNC_MARKER_LENGTH);
         }
 
-        m_totalLogNum++;
+        if (ms.m_chunkType == GlogChunkType::Whole || ms.m_chunkType == GlogChunkType::Last) {
+            m_totalLogNum++;
+        }
         m_totalLogSize += logLength;
         basePtr += SYNC_MARKER_LENGTH;
         m_position += SYNC_MARKER_LENGTH;
     }
+    m_position = recordBegin;
     InternalDebug("total log num:%zu, log size:%zu", m_totalLogNum.load(), m_totalLogSize.load());
 }
 
+static uint32_t checkpointChecksum(const Checkpoint &checkpoint) {
+    // FNV-1a
+    const auto *ptr = reinterpret_cast<const uint8_t *>(&checkpoint);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(Checkpoint, m_checksum); ++i) {
+        hash = (hash ^ ptr[i]) * 16777619u;
+    }
+    return hash;
+}
+
+void GlogFile::saveCheckpoint() {
+    const size_t size = m_size;
+    const size_t position = m_position;
+    if (position + CHECKPOINT_LENGTH > size) {
+        return;
+    }
+    Checkpoint checkpoint{.m_magic = CHECKPOINT_MAGIC,
+                          .m_fileSize = static_cast<uint32_t>(size),
+                          .m_position = static_cast<uint32_t>(position),
+                          .m_totalLogNum = static_cast<uint32_t>(m_totalLogNum),
+                          .m_totalLogSize = static_cast<uint32_t>(m_totalLogSize),
+                          .m_checksum = 0};
+    checkpoint.m_checksum = checkpointChecksum(checkpoint);
+    ::memcpy(static_cast<uint8_t *>(m_ptr) + size - CHECKPOINT_LENGTH, &checkpoint, CHECKPOINT_LENGTH);
+    m_checkpointDirty = true;
+}
+
+bool GlogFile::loadCheckpoint() {
+    const size_t size = m_size;
+    if (size < m_headerSize + CHECKPOINT_LENGTH) {
+        return false;
+    }
+    const auto *basePtr = static_cast<const uint8_t *>(m_ptr);
+    Checkpoint checkpoint{};
+    ::memcpy(&checkpoint, basePtr + size - CHECKPOINT_LENGTH, CHECKPOINT_LENGTH);
+    const size_t position = checkpoint.m_position;
+    if (checkpoint.m_magic != CHECKPOINT_MAGIC || checkpoint.m_checksum != checkpointChecksum(checkpoint) ||
+        checkpoint.m_fileSize != size || position < m_headerSize || position > size - CHECKPOINT_LENGTH) {
+        InternalDebug("no valid checkpoint in [%s]", m_path.c_str());
+        return false;
+    }
+    // pages of logs and checkpoint may not reach disk together before a power loss,
+    // position must be the end of a record and no record begins there
+    if (position > m_headerSize && (position < m_headerSize + SYNC_MARKER_LENGTH ||
+                                    ::memcmp(basePtr + position - SYNC_MARKER_LENGTH, SYNC_MARKER,
+                                             SYNC_MARKER_LENGTH) != 0)) {
+        InternalWarning("checkpoint of [%s] is ahead of logs, position:%zu", m_path.c_str(), position);
+        return false;
+    }
+    // any record has a non zero byte in its first 16 bytes: length, sync marker, iv or sequence
+    const size_t checkLength = std::min(size - CHECKPOINT_LENGTH - position, (size_t) 16);
+    for (size_t i = 0; i < checkLength; ++i) {
+        if (basePtr[position + i] != 0) {
+            InternalWarning("checkpoint of [%s] is behind logs, position:%zu", m_path.c_str(), position);
+            return false;
+        }
+    }
+    m_position = position;
+    m_totalLogNum = checkpoint.m_totalLogNum;
+    m_totalLogSize = checkpoint.m_totalLogSize;
+    InternalDebug("total log num:%zu, log size:%zu from checkpoint", m_totalLogNum.load(), m_totalLogSize.load());
+    return true;
+}
+
 bool GlogFile::writeRawData(const GlogBuffer &data) {
     if (!isFileAlreadyOpen()) {
         InternalWarning("fail to write raw data because the file [%s] is not open", m_path.c_str());
@@ -303,108 +761,367 @@ bool GlogFile::writeLogData(const GlogBuffer &data,
         InternalWarning("fail to write log data because the file loading [%s] is not completed", m_path.c_str());
         return false;
     }
-    GlogBuffer compressBuffer(SINGLE_LOG_CONTENT_MAX_LENGTH);
+    // compressed or encrypted content goes to scratch, caller's data is never modified
+    GlogBuffer &scratchBuffer = *m_scratchBuffer;
 
     bool needCompress = m_compressMode != format::GlogCompressMode::None && m_compressor;
     bool needEncrypt = m_encryptMode != format::GlogEncryptMode::None && m_cipherReady;
-    ModeSet modeSet{.m_compressMode = this->m_compressMode, .m_encryptMode = this->m_encryptMode};
     uint8_t iv[AES_KEY_LEN] = {};
 
+    // enough space for the worst case, deflate straight into mmap and skip the copy from scratch
+    if (needCompress &&
+        recordStoreSize(m_compressor->compressBound(data.getAvailLength()), needEncrypt) <= spaceLeft()) {
+        return compressInPlace(data, needEncrypt);
+    }
+
     if (needCompress) {
         InternalDebug("before compress len:%d", data.getAvailLength());
         // m_compressor->reset();
-        bool ret = m_compressor->compress(data, compressBuffer);
-        InternalDebug("after compress len:%d", compressBuffer.getAvailLength());
+        bool ret = m_compressor->compress(data, scratchBuffer);
+        InternalDebug("after compress len:%d", scratchBuffer.getAvailLength());
         if (!ret) {
             return false;
         }
     }
 
-    GlogBufferLength_t length = needCompress ? compressBuffer.getAvailLength() : data.getAvailLength();
+    GlogBufferLength_t length = needCompress ? scratchBuffer.getAvailLength() : data.getAvailLength();
 
-    if (logStoreSize(length, needEncrypt) > spaceLeft()) {
-        if (insufficientSpaceCallback) {
-            if (!insufficientSpaceCallback(logStoreSize(length, needEncrypt))) {
+    if (recordStoreSize(length, needEncrypt) > spaceLeft()) {
+        if (!insufficientSpaceCallback || !insufficientSpaceCallback(recordStoreSize(length, needEncrypt))) {
+            return false;
+        }
+        if (recordStoreSize(length, needEncrypt) > spaceLeft()) {
+            return false; // still no space to write
+        }
+        // recompress because compressor reset dictionary after archive
+        if (needCompress) {
+            bool ret = m_compressor->compress(data, scratchBuffer);
+            InternalDebug("after recompress len:%d", scratchBuffer.getAvailLength());
+            if (!ret) {
                 return false;
             }
-            if (logStoreSize(length, needEncrypt) > spaceLeft()) {
-                return false; // still no space to write
-            }
-            // recompress because compressor reset dictionary after archive
-            if (needCompress) {
-                bool ret = m_compressor->compress(data, compressBuffer);
-                InternalDebug("after recompress len:%d", compressBuffer.getAvailLength());
-                if (!ret) {
-                    return false;
-                }
-                length = compressBuffer.getAvailLength();
-                if (logStoreSize(length, needEncrypt) > spaceLeft()) {
-                    return false;
-                }
-            }
-            // redo encrypt because cipher may reset after archive
-            if (needEncrypt) { // AES CFB-128 won't change data size
-                if (needCompress) {
-                    AESCrypt::encryptOnce(compressBuffer.getPtr(), compressBuffer.getPtr(),
-                                          compressBuffer.getAvailLength(), &m_aesKey, iv);
-                } else {
-                    AESCrypt::encryptOnce(data.getPtr(), data.getPtr(), data.getAvailLength(), &m_aesKey, iv);
-                }
+            length = scratchBuffer.getAvailLength();
+            if (recordStoreSize(length, needEncrypt) > spaceLeft()) {
+                return false;
             }
         }
-    } else if (needEncrypt) {
-        if (needCompress) {
-            AESCrypt::encryptOnce(compressBuffer.getPtr(), compressBuffer.getPtr(), compressBuffer.getAvailLength(),
-                                  &m_aesKey, iv);
+    }
+
+    // encrypt after space is ensured because cipher may reset after archive
+    if (needEncrypt) { // AES CFB-128 won't change data size
+        const GlogBuffer &plain = needCompress ? scratchBuffer : data;
+        AESCrypt::encryptOnce(plain.getPtr(), scratchBuffer.getPtr(), length, &m_aesKey, iv);
+        scratchBuffer.setAvailLength(length);
+    }
+
+    return appendRecord(needCompress || needEncrypt ? scratchBuffer : data, needEncrypt, iv);
+}
+
+bool GlogFile::writeLargeLogData(const void *data,
+                                 size_t length,
+                                 const std::function<bool(uint32_t length)> &insufficientSpaceCallback,
+                                 bool withinOneCache) {
+    if (withinOneCache && !makeRoomForChunks(length, insufficientSpaceCallback)) {
+        return false;
+    }
+
+    const auto *ptr = static_cast<const uint8_t *>(data);
+    for (size_t offset = 0; offset < length; offset += LOG_CHUNK_LENGTH) {
+        size_t chunkLength = std::min(length - offset, (size_t) LOG_CHUNK_LENGTH);
+        GlogChunkType chunkType;
+        if (offset == 0) {
+            chunkType = GlogChunkType::First;
         } else {
-            AESCrypt::encryptOnce(data.getPtr(), data.getPtr(), data.getAvailLength(), &m_aesKey, iv);
+            chunkType = offset + chunkLength == length ? GlogChunkType::Last : GlogChunkType::Middle;
+        }
+        GlogBuffer chunk((void *) (ptr + offset), static_cast<GlogBufferLength_t>(chunkLength));
+        if (!writeChunkData(chunk, chunkType, insufficientSpaceCallback)) {
+            return false;
         }
     }
+    return true;
+}
 
-    // write log header
-    auto *basePtr = static_cast<uint8_t *>(m_ptr);
-    basePtr += m_position;
+bool GlogFile::writeChunkData(const GlogBuffer &chunk,
+                              GlogChunkType chunkType,
+                              const std::function<bool(uint32_t length)> &insufficientSpaceCallback) {
+    m_chunkType = chunkType;
+    bool ret = writeLogData(chunk, insufficientSpaceCallback);
+    m_chunkType = GlogChunkType::Whole;
+    return ret;
+}
+
+bool GlogFile::makeRoomForChunks(size_t length, const std::function<bool(uint32_t length)> &insufficientSpaceCallback) {
+    if (!isFileAlreadyOpen()) {
+        InternalDebug("fail to write log data because the file [%s] is not open", m_path.c_str());
+        return false;
+    }
+    bool needCompress = m_compressMode != format::GlogCompressMode::None && m_compressor;
+    bool needEncrypt = m_encryptMode != format::GlogEncryptMode::None && m_cipherReady;
+
+    size_t worstSize = 0;
+    for (size_t offset = 0; offset < length; offset += LOG_CHUNK_LENGTH) {
+        size_t chunkLength = std::min(length - offset, (size_t) LOG_CHUNK_LENGTH);
+        size_t storeLength = needCompress ? m_compressor->compressBound(chunkLength) : chunkLength;
+        worstSize += recordStoreSize(storeLength, needEncrypt);
+    }
+    if (worstSize > m_size - m_headerSize - CHECKPOINT_LENGTH) {
+        InternalWarning("log length [%zu] exceeds cache size [%zu], skip write", length, m_size.load());
+        return false;
+    }
+    if (worstSize > spaceLeft()) {
+        if (!insufficientSpaceCallback || !insufficientSpaceCallback(worstSize) || worstSize > spaceLeft()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool GlogFile::appendRecord(const GlogBuffer &content, bool cipher, const uint8_t *iv) {
+    InternalDebug("write record len:%d pos:%zu", content.getAvailLength(), m_position.load());
+    ::memcpy(recordContentPtr(cipher), content.getPtr(), content.getAvailLength());
+    return commitRecord(content.getAvailLength(), cipher, iv);
+}
+
+bool GlogFile::commitRecord(GlogBufferLength_t length, bool cipher, const uint8_t *iv) {
+    ModeSet modeSet{.m_compressMode = this->m_compressMode,
+                    .m_encryptMode = this->m_encryptMode,
+                    .m_chunkType = this->m_chunkType};
+
+    // backfill log header in front of content
+    auto *basePtr = static_cast<uint8_t *>(m_ptr) + m_position;
 
     GlogByte_t msNum = fromModeSet(modeSet);
     memcpy(basePtr, &msNum, sizeof(GlogByte_t));
     basePtr += sizeof(GlogByte_t);
-    m_position += sizeof(GlogByte_t);
 
-    if (needEncrypt) {
+    if (m_sequence) {
+        uint64_t sequenceLe = toLittleEndianU64(m_sequence->fetch_add(1));
+        memcpy(basePtr, &sequenceLe, SEQUENCE_BYTES);
+        basePtr += SEQUENCE_BYTES;
+    }
+
+    if (cipher) {
         memcpy(basePtr, iv, AES_KEY_LEN);
         basePtr += AES_KEY_LEN;
-        m_position += AES_KEY_LEN;
 
         memcpy(basePtr, m_clientPublicKey, ECC_PUBLIC_KEY_LEN);
         basePtr += ECC_PUBLIC_KEY_LEN;
-        m_position += ECC_PUBLIC_KEY_LEN;
     }
 
     GlogBufferLength_t lengthLe = toLittleEndianU16(length);
-
     ::memcpy(basePtr, &lengthLe, LOG_LENGTH_BYTES);
     basePtr += LOG_LENGTH_BYTES;
-    m_position += LOG_LENGTH_BYTES;
 
-    bool ret;
-    if (needCompress) {
-        ret = writeRawData(compressBuffer);
-    } else {
-        ret = writeRawData(data);
-    }
+    InternalDebug("write sync marker at position:%zu", m_position + recordHeaderSize(cipher) + length);
+    ::memcpy(basePtr + length, format::SYNC_MARKER, SYNC_MARKER_LENGTH);
 
-    if (ret) {
+    m_position += recordStoreSize(length, cipher);
+    if (m_chunkType == GlogChunkType::Whole || m_chunkType == GlogChunkType::Last) {
         m_totalLogNum++;
-        m_totalLogSize += needCompress ? compressBuffer.getAvailLength() : data.getAvailLength();
-        InternalDebug("write sync marker at position:%d", m_position.load());
-        ::memcpy(basePtr + length, format::SYNC_MARKER, SYNC_MARKER_LENGTH);
-        m_position += SYNC_MARKER_LENGTH;
+    }
+    m_totalLogSize += length;
+    saveCheckpoint();
+    return true;
+}
+
+bool GlogFile::compressInPlace(const GlogBuffer &data, bool cipher) {
+    // compressed content never exceed bound, caller makes sure bound fits in space left
+    size_t bound = std::min(m_compressor->compressBound(data.getAvailLength()), (size_t) SINGLE_LOG_CONTENT_MAX_LENGTH);
+    uint8_t *contentPtr = recordContentPtr(cipher);
+    GlogBuffer content(contentPtr, static_cast<GlogBufferLength_t>(bound));
+
+    InternalDebug("before compress in place len:%d", data.getAvailLength());
+    if (!m_compressor->compress(data, content)) {
+        return false;
+    }
+    InternalDebug("after compress in place len:%d", content.getAvailLength());
+
+    uint8_t iv[AES_KEY_LEN] = {};
+    if (cipher) { // AES CFB-128 won't change data size
+        AESCrypt::encryptOnce(contentPtr, contentPtr, content.getAvailLength(), &m_aesKey, iv);
+    }
+    return commitRecord(content.getAvailLength(), cipher, iv);
+}
+
+bool GlogFile::writeLogBatch(const struct iovec *logs,
+                             size_t num,
+                             const std::function<bool(uint32_t length)> &insufficientSpaceCallback) {
+    if (!isFileAlreadyOpen()) {
+        InternalDebug("fail to write log data because the file [%s] is not open", m_path.c_str());
+        return false;
+    }
+    if (!m_loadFileCompleted) {
+        InternalWarning("fail to write log data because the file loading [%s] is not completed", m_path.c_str());
+        return false;
+    }
+    bool needCompress = m_compressMode != format::GlogCompressMode::None && m_compressor;
+    bool needEncrypt = m_encryptMode != format::GlogEncryptMode::None && m_cipherReady;
+
+    // check space for the whole batch once, compressed size never exceed compressor's bound
+    size_t worstSize = 0;
+    for (size_t i = 0; i < num; ++i) {
+        auto length = static_cast<GlogBufferLength_t>(logs[i].iov_len);
+        worstSize += recordStoreSize(needCompress ? m_compressor->compressBound(length) : length, needEncrypt);
+    }
+    if (worstSize > spaceLeft()) {
+        // cache will be archived in the middle of batch, write one by one
+        bool ret = true;
+        for (size_t i = 0; i < num; ++i) {
+            GlogBuffer data(logs[i].iov_base, static_cast<GlogBufferLength_t>(logs[i].iov_len));
+            ret &= writeLogData(data, insufficientSpaceCallback);
+        }
+        return ret;
+    }
+
+    GlogBuffer &scratchBuffer = *m_scratchBuffer;
+    bool ret = true;
+    for (size_t i = 0; i < num; ++i) {
+        GlogBuffer data(logs[i].iov_base, static_cast<GlogBufferLength_t>(logs[i].iov_len));
+        // whole batch fits in worst case, so every record does
+        if (needCompress) {
+            ret &= compressInPlace(data, needEncrypt);
+            continue;
+        }
+        uint8_t iv[AES_KEY_LEN] = {};
+        if (needEncrypt) { // AES CFB-128 won't change data size
+            AESCrypt::encryptOnce(data.getPtr(), scratchBuffer.getPtr(), data.getAvailLength(), &m_aesKey, iv);
+            scratchBuffer.setAvailLength(data.getAvailLength());
+        }
+        ret &= appendRecord(needEncrypt ? scratchBuffer : data, needEncrypt, iv);
     }
     return ret;
 }
 
+void *GlogFile::reserveLogData(GlogBufferLength_t length,
+                               const std::function<bool(uint32_t length)> &insufficientSpaceCallback) {
+    if (!isFileAlreadyOpen()) {
+        InternalDebug("fail to reserve log data because the file [%s] is not open", m_path.c_str());
+        return nullptr;
+    }
+    if (!m_loadFileCompleted) {
+        InternalWarning("fail to reserve log data because the file loading [%s] is not completed", m_path.c_str());
+        return nullptr;
+    }
+    if (m_compressMode != format::GlogCompressMode::None || m_encryptMode != format::GlogEncryptMode::None) {
+        InternalWarning("fail to reserve log data because the file [%s] needs compression or encryption",
+                        m_path.c_str());
+        return nullptr;
+    }
+    if (m_reservedLength > 0) {
+        InternalWarning("fail to reserve log data because last reservation is not committed");
+        return nullptr;
+    }
+
+    if (recordStoreSize(length, false) > spaceLeft()) {
+        if (!insufficientSpaceCallback || !insufficientSpaceCallback(recordStoreSize(length, false))) {
+            return nullptr;
+        }
+        if (recordStoreSize(length, false) > spaceLeft()) {
+            return nullptr; // still no space to write
+        }
+    }
+    m_reservedLength = length;
+    return recordContentPtr(false);
+}
+
+bool GlogFile::commitLogData(GlogBufferLength_t length) {
+    if (m_reservedLength == 0) {
+        InternalWarning("fail to commit log data because nothing reserved");
+        return false;
+    }
+    GlogBufferLength_t reservedLength = m_reservedLength;
+    m_reservedLength = 0;
+    if (length == 0) {
+        return true;
+    }
+    if (length > reservedLength) {
+        InternalError("commit length [%d] exceeds reserved length [%d]", length, reservedLength);
+        return false;
+    }
+    // content already in place
+    return commitRecord(length, false, nullptr);
+}
+
+bool GlogFile::nextSequencedRecord(size_t &offset, SequencedRecord &outRecord) const {
+    const auto *basePtr = static_cast<const uint8_t *>(m_ptr);
+    const size_t end = m_position;
+
+    while (m_sequence && offset < end) {
+        const uint8_t *recordPtr = basePtr + offset;
+        const size_t remain = end - offset;
+        ModeSet ms = toModeSet(*recordPtr);
+        const bool cipher = ms.m_encryptMode == format::GlogEncryptMode::AES;
+        bool valid = ms.m_compressMode >= GlogCompressMode::None && ms.m_compressMode <= GlogCompressMode::Zlib &&
+                     ms.m_encryptMode >= format::GlogEncryptMode::None &&
+                     ms.m_encryptMode <= format::GlogEncryptMode::AES && remain >= recordStoreSize(1, cipher);
+        GlogBufferLength_t logLength = 0;
+        if (valid) {
+            ::memcpy(&logLength, recordPtr + recordHeaderSize(cipher) - LOG_LENGTH_BYTES, LOG_LENGTH_BYTES);
+            logLength = readU16Le(logLength);
+            valid = logLength > 0 && logLength <= SINGLE_LOG_CONTENT_MAX_LENGTH &&
+                    recordStoreSize(logLength, cipher) <= remain &&
+                    ::memcmp(recordPtr + recordHeaderSize(cipher) + logLength, SYNC_MARKER, SYNC_MARKER_LENGTH) == 0;
+        }
+        if (!valid) {
+            // skip broken bytes by search next sync marker
+            int64_t syncPos = searchSyncMarker(recordPtr + 1, remain - 1);
+            if (syncPos == -1) {
+                offset = end;
+                break;
+            }
+            offset += 1 + syncPos + SYNC_MARKER_LENGTH;
+            continue;
+        }
+        uint64_t sequenceLe = 0;
+        ::memcpy(&sequenceLe, recordPtr + 1, SEQUENCE_BYTES);
+        outRecord.m_sequence = readU64Le(sequenceLe);
+        outRecord.m_ptr = recordPtr;
+        outRecord.m_storeSize = recordStoreSize(logLength, cipher);
+        outRecord.m_length = logLength;
+        offset += outRecord.m_storeSize;
+        return true;
+    }
+    return false;
+}
+
+bool GlogFile::appendSequencedRecord(const SequencedRecord &record) {
+    if (m_sequence || record.m_storeSize - SEQUENCE_BYTES > spaceLeft()) {
+        return false;
+    }
+    // mode set, then everything after sequence number
+    auto *basePtr = static_cast<uint8_t *>(m_ptr) + m_position;
+    *basePtr = *record.m_ptr;
+    ::memcpy(basePtr + 1, record.m_ptr + 1 + SEQUENCE_BYTES, record.m_storeSize - 1 - SEQUENCE_BYTES);
+
+    m_position += record.m_storeSize - SEQUENCE_BYTES;
+    m_totalLogNum++;
+    m_totalLogSize += record.m_length;
+    saveCheckpoint();
+    return true;
+}
+
+void GlogFile::clear() {
+    if (!isFileAlreadyOpen()) {
+        return;
+    }
+    // zero logs or they are recovered again after restart
+    ::memset(static_cast<uint8_t *>(m_ptr) + m_headerSize, 0, m_position - m_headerSize);
+    m_dirtyEnd = std::max(m_dirtyEnd, m_position.load());
+    m_syncedPosition = std::min(m_syncedPosition, m_headerSize);
+    resetInternalState();
+    saveCheckpoint();
+    if (m_compressor) {
+        m_compressor->reset();
+    }
+    m_cipherReady = resetAesKey();
+}
+
 #define __TRY_RECOVER_READ(offset, ret)                                                                                \
-    int64_t syncPos = searchSyncMarkerInFile(m_file, m_fd, m_position + (offset), m_size);                             \
+    if (m_readingBackward) {                                                                                           \
+        return ret;                                                                                                    \
+    }                                                                                                                  \
+    int64_t syncPos = searchSyncMarker(m_position + (offset));                                                         \
     InternalDebug("found sync marker at position:%lld", syncPos);                                                      \
     if (syncPos == -1) {                                                                                               \
         return ret;                                                                                                    \
@@ -414,18 +1131,170 @@ bool GlogFile::writeLogData(const GlogBuffer &data,
     }
 
 int GlogReader::read(GlogBuffer &outBuffer) {
+    int ret = read(outBuffer.getPtr(), outBuffer.getCapacity());
+    if (ret > 0) {
+        outBuffer.setAvailLength(static_cast<GlogBufferLength_t>(ret));
+    }
+    return ret;
+}
+
+int GlogReader::read(void *outBuffer, size_t capacity) {
+    if (capacity == 0) {
+        return -1;
+    }
+    if (!m_pendingLog.empty()) {
+        return takePendingLog(static_cast<uint8_t *>(outBuffer), capacity);
+    }
+    return readLog(static_cast<uint8_t *>(outBuffer), capacity, nullptr);
+}
+
+int GlogReader::readBatch(void *arena, size_t capacity, uint32_t *offsets, uint32_t *lengths, size_t maxLogs) {
+    if (capacity == 0 || maxLogs == 0) {
+        return -1;
+    }
+    auto *arenaPtr = static_cast<uint8_t *>(arena);
+    size_t used = 0;
+    size_t count = 0;
+    while (count < maxLogs && used < capacity) {
+        uint8_t *outPtr = arenaPtr + used;
+        const size_t remain = capacity - used;
+        int bytes;
+        if (!m_pendingLog.empty()) {
+            // log which didn't fit in the rest of last arena
+            if (m_pendingLog.size() > remain && count > 0) {
+                break;
+            }
+            bytes = takePendingLog(outPtr, remain);
+        } else {
+            bytes = readLog(outPtr, remain, &m_pendingLog);
+        }
+        if (bytes == 0) {
+            continue;
+        }
+        if (bytes < 0) {
+            if (bytes == -11) {
+                // pending for next batch, or longer than the whole arena and skipped
+                if (!m_pendingLog.empty() && count > 0) {
+                    break;
+                }
+                continue;
+            }
+            if (count == 0) {
+                return bytes;
+            }
+            break;
+        }
+        offsets[count] = static_cast<uint32_t>(used);
+        lengths[count] = static_cast<uint32_t>(bytes);
+        used += bytes;
+        count++;
+    }
+    return static_cast<int>(count);
+}
+
+int GlogReader::takePendingLog(uint8_t *outPtr, size_t capacity) {
+    const size_t length = m_pendingLog.size();
+    if (length > capacity) {
+        InternalWarning("log length [%zu] exceeds buffer capacity [%zu], skip it", length, capacity);
+        m_pendingLog.clear();
+        return -11;
+    }
+    ::memcpy(outPtr, m_pendingLog.data(), length);
+    m_pendingLog.clear();
+    return static_cast<int>(length);
+}
+
+int GlogReader::readLog(uint8_t *outPtr, size_t capacity, std::vector<uint8_t> *spill) {
+    size_t length = 0;
+    bool overflow = false;
+    while (true) {
+        // decode in place while any chunk fits, or go through chunk buffer
+        const size_t remain = length < capacity ? capacity - length : 0;
+        const bool inPlace = remain >= SINGLE_LOG_CONTENT_MAX_LENGTH;
+        if (!inPlace && !m_chunkBuffer) {
+            m_chunkBuffer = new GlogBuffer(SINGLE_LOG_CONTENT_MAX_LENGTH);
+        }
+        GlogBuffer placeBuffer(outPtr + length, static_cast<GlogBufferLength_t>(std::min(remain, (size_t) UINT16_MAX)));
+        GlogBuffer &chunk = inPlace ? placeBuffer : *m_chunkBuffer;
+
+        GlogChunkType chunkType = GlogChunkType::Whole;
+        int bytes = readChunk(chunk, chunkType);
+        if (bytes <= 0) {
+            if (spill) {
+                spill->clear();
+            }
+            return bytes;
+        }
+        // rest of long log in progress is lost, start over with this one
+        if ((chunkType == GlogChunkType::Whole || chunkType == GlogChunkType::First) && length > 0) {
+            InternalWarning("file [%s] broken before position:%zu, drop part of long log", m_file.c_str(), m_position);
+            if (inPlace) {
+                ::memmove(outPtr, outPtr + length, bytes);
+            }
+            length = 0;
+            overflow = false;
+            if (spill) {
+                spill->clear();
+            }
+        }
+        if (!inPlace) {
+            if (length + bytes <= capacity) {
+                ::memcpy(outPtr + length, chunk.getPtr(), bytes);
+            } else {
+                // keep the whole log aside if caller wants it
+                if (spill && !overflow) {
+                    spill->assign(outPtr, outPtr + length);
+                }
+                if (spill) {
+                    auto *chunkPtr = static_cast<const uint8_t *>(chunk.getPtr());
+                    spill->insert(spill->end(), chunkPtr, chunkPtr + bytes);
+                }
+                overflow = true;
+            }
+        }
+        length += bytes;
+        if (chunkType == GlogChunkType::Whole || chunkType == GlogChunkType::Last) {
+            if (overflow) {
+                if (!spill) {
+                    InternalWarning("log length [%zu] exceeds buffer capacity [%zu], skip it", length, capacity);
+                }
+                return -11;
+            }
+            return static_cast<int>(length);
+        }
+    }
+}
+
+int GlogReader::readChunk(GlogBuffer &outBuffer, GlogChunkType &outChunkType) {
+    while (true) {
+        int bytes = readRecord(outBuffer, outChunkType, m_decompressor);
+        if (bytes <= 0) {
+            // whatever follows is not the rest of current long log
+            m_inChunkedLog = false;
+            return bytes;
+        }
+        if ((outChunkType == GlogChunkType::Middle || outChunkType == GlogChunkType::Last) && !m_inChunkedLog) {
+            InternalDebug("skip chunk without first one before position:%zu", m_position);
+            continue;
+        }
+        m_inChunkedLog = outChunkType == GlogChunkType::First || outChunkType == GlogChunkType::Middle;
+        return bytes;
+    }
+}
+
+int GlogReader::readRecord(GlogBuffer &outBuffer, GlogChunkType &outChunkType, Decompressor *decompressor) {
     if (!m_loadFileCompleted || outBuffer.getCapacity() <= 0 || !isFileAlreadyOpen()) {
         return -1;
     }
     if (spaceRemain() <= LOG_LENGTH_BYTES + 1 + SYNC_MARKER_LENGTH) {
         return -2;
     }
+    const uint8_t *mapped = m_archive->mapped();
     GlogByte_t msNum = 0;
-    int bytes = readSpecifySize(m_fd, &msNum, 1);
-    if (bytes <= 0) {
+    if (!readBytes(&msNum, 1)) {
         return -3;
     }
-    m_position += bytes;
+    m_position += 1;
     ModeSet ms = toModeSet(msNum);
     if (ms.m_compressMode < GlogCompressMode::None || ms.m_compressMode > GlogCompressMode::Zlib ||
         ms.m_encryptMode < format::GlogEncryptMode::None || ms.m_encryptMode > format::GlogEncryptMode::AES) {
@@ -439,6 +1308,7 @@ int GlogReader::read(GlogBuffer &outBuffer) {
         return -5;
     }
     const bool needDecompress = ms.m_compressMode == format::GlogCompressMode::Zlib;
+    outChunkType = ms.m_chunkType;
 
     if (spaceRemain() < logStoreSize(1, needDecrypt)) {
         return -6;
@@ -448,29 +1318,26 @@ int GlogReader::read(GlogBuffer &outBuffer) {
     uint8_t clientPubKey[ECC_PUBLIC_KEY_LEN] = {};
 
     if (needDecrypt) {
-        bytes = readSpecifySize(m_fd, iv, AES_KEY_LEN);
-        if (bytes <= 0) {
+        if (!readBytes(iv, AES_KEY_LEN)) {
             return -7;
         }
-        m_position += bytes;
+        m_position += AES_KEY_LEN;
 
-        bytes = readSpecifySize(m_fd, clientPubKey, ECC_PUBLIC_KEY_LEN);
-        if (bytes <= 0) {
+        if (!readBytes(clientPubKey, ECC_PUBLIC_KEY_LEN)) {
             return -8;
         }
-        m_position += bytes;
+        m_position += ECC_PUBLIC_KEY_LEN;
     }
 
     GlogBufferLength_t logLength = 0;
-    bytes = readSpecifySize(m_fd, &logLength, LOG_LENGTH_BYTES);
-    if (bytes <= 0) {
+    if (!readBytes(&logLength, LOG_LENGTH_BYTES)) {
         return -9;
     }
-    m_position += bytes;
+    m_position += LOG_LENGTH_BYTES;
 
     if (logLength == 0 || logLength > SINGLE_LOG_CONTENT_MAX_LENGTH) {
         // try recover
-        InternalWarning("file [%s] broken at position:%d", m_file.c_str(), m_position - bytes);
+        InternalWarning("file [%s] broken at position:%d", m_file.c_str(), m_position - LOG_LENGTH_BYTES);
         __TRY_RECOVER_READ(0, -10);
     }
 
@@ -478,30 +1345,39 @@ int GlogReader::read(GlogBuffer &outBuffer) {
         return -11;
     }
 
+    const openssl::AES_KEY *aesKey = nullptr;
     InternalDebug("need decompress:%d, need decrypt:%d", needDecompress, needDecrypt);
+    int bytes;
     if (needDecompress) {
-        GlogBuffer inBuffer(logLength);
-        bytes = readSpecifySize(m_fd, inBuffer.getPtr(), logLength);
-        if (bytes <= 0) {
-            return -12;
+        // inflate straight from mapped archive if it's plain, decrypt or read into record buffer otherwise
+        const uint8_t *payload = mapped ? mapped + m_position : nullptr;
+        if (!payload || needDecrypt) {
+            if (!m_recordBuffer) {
+                m_recordBuffer = new GlogBuffer(SINGLE_LOG_CONTENT_MAX_LENGTH);
+            }
+            if (!payload) {
+                if (!readBytes(m_recordBuffer->getPtr(), logLength)) {
+                    return -12;
+                }
+                payload = static_cast<const uint8_t *>(m_recordBuffer->getPtr());
+            }
         }
         if (needDecrypt) {
-            uint8_t userKey[32] = {};
-            openssl::AES_KEY aesKey = {};
-
-            if (uECC_shared_secret(clientPubKey, m_serverPrivateKey, userKey, uECC_secp256k1()) == 0) {
-                return -13;
-            }
-
-            if (AES_set_encrypt_key(userKey, AES_KEY_BITSET_LEN, &aesKey) != 0) {
-                return -14;
+            int ret = aesKeyFor(clientPubKey, aesKey);
+            if (ret != 0) {
+                return ret == -1 ? -13 : -14;
             }
-            AESCrypt::decryptOnce(inBuffer.getPtr(), inBuffer.getPtr(), bytes, &aesKey, iv);
+            AESCrypt::decryptOnce(payload, m_recordBuffer->getPtr(), logLength, aesKey, iv);
+            payload = static_cast<const uint8_t *>(m_recordBuffer->getPtr());
         }
         // m_decompressor->reset();
-        bool ret = m_decompressor->decompress(inBuffer, outBuffer);
+        GlogBuffer inBuffer(const_cast<uint8_t *>(payload), logLength);
+        bool ret = decompressor->decompress(inBuffer, outBuffer);
         if (!ret) {
-            InternalWarning("fail to decompress [%s] offset:%zu length:%zu", m_file.c_str(), m_position, logLength);
+            if (!m_readingBackward) {
+                InternalWarning("fail to decompress [%s] offset:%zu length:%zu", m_file.c_str(), m_position,
+                                logLength);
+            }
             __TRY_RECOVER_READ(logLength, -15);
             // if chunk in next position compressed with initial state, should invoke m_decompressor->reset();
             // but there's no way to know if next chunk was compressed with initial state or inflight state.
@@ -509,33 +1385,32 @@ int GlogReader::read(GlogBuffer &outBuffer) {
         m_position += logLength;
         bytes = outBuffer.getAvailLength();
     } else {
-        bytes = readSpecifySize(m_fd, outBuffer.getPtr(), logLength);
-        if (bytes <= 0) {
+        // decrypt from mapped archive into caller's buffer, or in place after read
+        const uint8_t *payload = static_cast<const uint8_t *>(outBuffer.getPtr());
+        if (mapped && needDecrypt) {
+            payload = mapped + m_position;
+        } else if (!readBytes(outBuffer.getPtr(), logLength)) {
             return -16;
         }
-        outBuffer.setAvailLength(bytes);
+        outBuffer.setAvailLength(logLength);
         if (needDecrypt) {
-            uint8_t userKey[32] = {};
-            openssl::AES_KEY aesKey = {};
-
-            if (uECC_shared_secret(clientPubKey, m_serverPrivateKey, userKey, uECC_secp256k1()) == 0) {
-                return -17;
-            }
-            if (AES_set_encrypt_key(userKey, AES_KEY_BITSET_LEN, &aesKey) != 0) {
-                return -18;
+            int ret = aesKeyFor(clientPubKey, aesKey);
+            if (ret != 0) {
+                return ret == -1 ? -17 : -18;
             }
-            AESCrypt::decryptOnce(outBuffer.getPtr(), outBuffer.getPtr(), bytes, &aesKey, iv);
+            AESCrypt::decryptOnce(payload, outBuffer.getPtr(), logLength, aesKey, iv);
         }
         m_position += logLength;
+        bytes = logLength;
     }
 
     uint8_t syncMarker[SYNC_MARKER_LENGTH] = {};
-    int n = readSpecifySize(m_fd, syncMarker, SYNC_MARKER_LENGTH);
-    if (n <= 0) {
+    const uint8_t *marker = mapped ? mapped + m_position : syncMarker;
+    if (!mapped && !readBytes(syncMarker, SYNC_MARKER_LENGTH)) {
         return -19;
     }
 
-    if (::memcmp(syncMarker, format::SYNC_MARKER, SYNC_MARKER_LENGTH) != 0) {
+    if (::memcmp(marker, format::SYNC_MARKER, SYNC_MARKER_LENGTH) != 0) {
         InternalWarning("file [%s] broken at position:%d", m_file.c_str(), m_position);
         __TRY_RECOVER_READ(SYNC_MARKER_LENGTH, -20);
     }
@@ -544,17 +1419,317 @@ int GlogReader::read(GlogBuffer &outBuffer) {
     return bytes;
 }
 
+int GlogReader::readBackward(GlogBuffer &outBuffer) {
+    int ret = readBackward(outBuffer.getPtr(), outBuffer.getCapacity());
+    if (ret > 0) {
+        outBuffer.setAvailLength(static_cast<GlogBufferLength_t>(ret));
+    }
+    return ret;
+}
+
+int GlogReader::readBackward(void *outBuffer, size_t capacity) {
+    if (capacity == 0 || !m_loadFileCompleted || !isFileAlreadyOpen()) {
+        return -1;
+    }
+    if (!m_backwardStarted) {
+        m_backwardEnd = m_archive->m_size;
+        m_backwardStarted = true;
+    }
+    auto *outPtr = static_cast<uint8_t *>(outBuffer);
+    while (true) {
+        if (m_backwardRecords.empty()) {
+            int ret = decodeBackward();
+            if (ret <= 0) {
+                // whatever comes before is not the rest of current long log
+                m_backwardChunks.clear();
+                return ret;
+            }
+        }
+        const BackwardRecord record = m_backwardRecords.back();
+        m_backwardRecords.pop_back();
+        const uint8_t *data = m_backwardData.data() + record.m_offset;
+
+        if (record.m_chunkType == GlogChunkType::Whole || record.m_chunkType == GlogChunkType::Last) {
+            if (!m_backwardChunks.empty()) {
+                InternalWarning("file [%s] broken before position:%zu, drop part of long log", m_file.c_str(),
+                                m_backwardEnd);
+                m_backwardChunks.clear();
+            }
+            if (record.m_chunkType == GlogChunkType::Whole) {
+                if (record.m_length > capacity) {
+                    InternalWarning("log length [%zu] exceeds buffer capacity [%zu], skip it", record.m_length,
+                                    capacity);
+                    return -11;
+                }
+                ::memcpy(outPtr, data, record.m_length);
+                return static_cast<int>(record.m_length);
+            }
+        } else if (m_backwardChunks.empty()) {
+            InternalDebug("skip chunk without last one after position:%zu", m_backwardEnd);
+            continue;
+        }
+        m_backwardChunks.emplace_back(data, data + record.m_length);
+        if (record.m_chunkType != GlogChunkType::First) {
+            continue;
+        }
+        // chunks are collected from Last to First
+        size_t length = 0;
+        for (const auto &chunk : m_backwardChunks) {
+            length += chunk.size();
+        }
+        if (length > capacity) {
+            InternalWarning("log length [%zu] exceeds buffer capacity [%zu], skip it", length, capacity);
+            m_backwardChunks.clear();
+            return -11;
+        }
+        size_t offset = 0;
+        for (auto itr = m_backwardChunks.rbegin(); itr != m_backwardChunks.rend(); ++itr) {
+            ::memcpy(outPtr + offset, itr->data(), itr->size());
+            offset += itr->size();
+        }
+        m_backwardChunks.clear();
+        return static_cast<int>(length);
+    }
+}
+
+int GlogReader::decodeBackward() {
+    const size_t headerSize = m_archive->m_headerSize;
+    if (m_backwardEnd <= headerSize) {
+        return -2;
+    }
+    const int64_t start = findRecordStart(m_backwardEnd);
+    if (start < 0) {
+        // bytes before m_backwardEnd are not a record, go on from previous sync marker
+        int64_t marker = m_archive->searchSyncMarkerBackward(headerSize - SYNC_MARKER_LENGTH, m_backwardEnd - 1);
+        InternalWarning("file [%s] broken before position:%zu", m_file.c_str(), m_backwardEnd);
+        m_backwardEnd = marker < 0 ? headerSize : static_cast<size_t>(marker + SYNC_MARKER_LENGTH);
+        return 0;
+    }
+    // records after the newest stream start found are in that stream, decode from it again
+    int ret = -15;
+    if (m_backwardStreamStart > 0 && m_backwardStreamStart <= static_cast<size_t>(start)) {
+        ret = decodeRange(m_backwardStreamStart, m_backwardRecoverFrom);
+    }
+    if (ret <= 0) {
+        // compressed record depends on ones before it, step back to where a fresh stream starts,
+        // every cache flushed into archive starts one
+        m_backwardStreamStart = 0;
+        size_t recoverFrom = SIZE_MAX;
+        int64_t begin = start;
+        bool fromHeader = false;
+        while (true) {
+            // most records refer to ones before them and fail at once, decode the rest only after one doesn't
+            ret = decodeOne(static_cast<size_t>(begin));
+            if (ret > 0) {
+                ret = decodeRange(static_cast<size_t>(begin), recoverFrom);
+            }
+            if (ret != -15) {
+                break;
+            }
+            int64_t previous = findRecordStart(static_cast<size_t>(begin));
+            // broken bytes before begin, go on from the last whole record before them and skip them like read
+            for (size_t end = static_cast<size_t>(begin); previous < 0 && end > headerSize;) {
+                int64_t marker = m_archive->searchSyncMarkerBackward(headerSize - SYNC_MARKER_LENGTH, end - 1);
+                if (marker < 0) {
+                    break;
+                }
+                end = static_cast<size_t>(marker + SYNC_MARKER_LENGTH);
+                previous = findRecordStart(end);
+                recoverFrom = end;
+            }
+            if (previous < 0) {
+                break;
+            }
+            begin = previous;
+            // archive start is a stream start too, decode from it once it's nearer than what's stepped over
+            if (!fromHeader && static_cast<size_t>(begin) - headerSize < static_cast<size_t>(start - begin)) {
+                fromHeader = true;
+                ret = decodeRange(headerSize, recoverFrom);
+                if (ret > 0) {
+                    begin = static_cast<int64_t>(headerSize);
+                    break;
+                }
+            }
+        }
+        if (ret > 0) {
+            m_backwardStreamStart = static_cast<size_t>(begin);
+            m_backwardRecoverFrom = recoverFrom;
+        }
+    }
+    if (ret > 0) {
+        m_backwardEnd = m_backwardRecords.front().m_position;
+        return ret;
+    }
+    InternalWarning("fail to decode [%s] before position:%zu backward, ret:%d, skip it", m_file.c_str(),
+                    m_backwardEnd, ret);
+    m_backwardEnd = static_cast<size_t>(start);
+    return 0;
+}
+
+// decoded bytes kept by one pass from stream start, older records are decoded again by next pass
+static const size_t BACKWARD_DECODED_LIMIT = 4 * 1024 * 1024;
+
+int GlogReader::decodeOne(size_t begin) {
+    prepareBackwardDecode();
+    const size_t position = m_position;
+    m_position = begin;
+    m_readingBackward = true;
+    GlogChunkType chunkType = GlogChunkType::Whole;
+    int bytes = readRecord(*m_chunkBuffer, chunkType, m_backwardDecompressor);
+    m_readingBackward = false;
+    m_position = position;
+    return bytes == 0 ? -15 : bytes;
+}
+
+void GlogReader::prepareBackwardDecode() {
+    if (!m_chunkBuffer) {
+        m_chunkBuffer = new GlogBuffer(SINGLE_LOG_CONTENT_MAX_LENGTH);
+    }
+    if (!m_backwardDecompressor) {
+        m_backwardDecompressor = new ZlibDecompressor();
+    }
+    m_backwardDecompressor->reset();
+}
+
+int GlogReader::decodeRange(size_t begin, size_t recoverFrom) {
+    prepareBackwardDecode();
+    m_backwardData.clear();
+    m_backwardRecords.clear();
+
+    const size_t position = m_position;
+    m_position = begin;
+    int ret = 0;
+    while (m_position < m_backwardEnd) {
+        const size_t recordStart = m_position;
+        m_readingBackward = m_position < recoverFrom;
+        GlogChunkType chunkType = GlogChunkType::Whole;
+        int bytes = readRecord(*m_chunkBuffer, chunkType, m_backwardDecompressor);
+        if (bytes == 0 && !m_readingBackward) {
+            // broken bytes skipped
+            continue;
+        }
+        if (bytes <= 0 || m_position > m_backwardEnd) {
+            if (m_readingBackward) {
+                ret = bytes < 0 ? bytes : -15;
+                m_backwardData.clear();
+                m_backwardRecords.clear();
+            }
+            break;
+        }
+        m_backwardRecords.push_back(
+                BackwardRecord{chunkType, recordStart, m_backwardData.size(), static_cast<size_t>(bytes)});
+        auto *chunkPtr = static_cast<const uint8_t *>(m_chunkBuffer->getPtr());
+        m_backwardData.insert(m_backwardData.end(), chunkPtr, chunkPtr + bytes);
+        if (m_backwardData.size() > 2 * BACKWARD_DECODED_LIMIT) {
+            dropOldestDecoded(BACKWARD_DECODED_LIMIT);
+        }
+    }
+    m_readingBackward = false;
+    m_position = position;
+    return ret < 0 ? ret : static_cast<int>(m_backwardRecords.size());
+}
+
+void GlogReader::dropOldestDecoded(size_t keep) {
+    size_t dropped = 0;
+    while (dropped < m_backwardRecords.size() - 1 &&
+           m_backwardData.size() - m_backwardRecords[dropped].m_offset > keep) {
+        dropped++;
+    }
+    const size_t offset = m_backwardRecords[dropped].m_offset;
+    m_backwardRecords.erase(m_backwardRecords.begin(), m_backwardRecords.begin() + dropped);
+    for (auto &record : m_backwardRecords) {
+        record.m_offset -= offset;
+    }
+    m_backwardData.erase(m_backwardData.begin(), m_backwardData.begin() + offset);
+}
+
+int64_t GlogReader::findRecordStart(size_t end) {
+    const size_t headerSize = m_archive->m_headerSize;
+    uint8_t marker[SYNC_MARKER_LENGTH] = {};
+    if (end < headerSize + LOG_LENGTH_BYTES + 1 + 1 + SYNC_MARKER_LENGTH ||
+        !m_archive->readAt(marker, SYNC_MARKER_LENGTH, end - SYNC_MARKER_LENGTH) ||
+        ::memcmp(marker, format::SYNC_MARKER, SYNC_MARKER_LENGTH) != 0) {
+        return -1;
+    }
+    // record is never longer than this, content may contain sync marker by chance
+    const size_t maxStoreSize = logStoreSize(SINGLE_LOG_CONTENT_MAX_LENGTH, true);
+    const size_t floor = std::max(headerSize, end > maxStoreSize ? end - maxStoreSize : 0) - SYNC_MARKER_LENGTH;
+    size_t searchEnd = end - SYNC_MARKER_LENGTH;
+    while (searchEnd >= floor + SYNC_MARKER_LENGTH) {
+        int64_t found = m_archive->searchSyncMarkerBackward(floor, searchEnd);
+        if (found < 0) {
+            return -1;
+        }
+        const size_t start = static_cast<size_t>(found) + SYNC_MARKER_LENGTH;
+        if (isRecordAt(start, end)) {
+            return static_cast<int64_t>(start);
+        }
+        searchEnd = static_cast<size_t>(found) + SYNC_MARKER_LENGTH - 1;
+    }
+    return -1;
+}
+
+bool GlogReader::isRecordAt(size_t start, size_t end) {
+    GlogByte_t msNum = 0;
+    if (start < m_archive->m_headerSize || !m_archive->readAt(&msNum, 1, start)) {
+        return false;
+    }
+    ModeSet ms = toModeSet(msNum);
+    if (ms.m_compressMode < GlogCompressMode::None || ms.m_compressMode > GlogCompressMode::Zlib ||
+        ms.m_encryptMode < format::GlogEncryptMode::None || ms.m_encryptMode > format::GlogEncryptMode::AES) {
+        return false;
+    }
+    const size_t headerSize = logHeaderSize(ms.m_encryptMode == format::GlogEncryptMode::AES);
+    if (end < start + headerSize + 1 + SYNC_MARKER_LENGTH) {
+        return false;
+    }
+    GlogBufferLength_t logLength = 0;
+    if (!m_archive->readAt(&logLength, LOG_LENGTH_BYTES, start + headerSize - LOG_LENGTH_BYTES)) {
+        return false;
+    }
+    return logLength <= SINGLE_LOG_CONTENT_MAX_LENGTH && start + headerSize + logLength + SYNC_MARKER_LENGTH == end;
+}
+
+int GlogReader::aesKeyFor(const uint8_t *clientPublicKey, const openssl::AES_KEY *&outAesKey) {
+    for (size_t i = 0; i < AES_KEY_CACHE_SIZE; ++i) {
+        // most likely the same key as last record
+        AesKeyCacheEntry &entry = m_aesKeyCache[(m_lastAesKeyIndex + i) % AES_KEY_CACHE_SIZE];
+        if (entry.m_valid && memcmp(entry.m_clientPublicKey, clientPublicKey, ECC_PUBLIC_KEY_LEN) == 0) {
+            m_lastAesKeyIndex = (m_lastAesKeyIndex + i) % AES_KEY_CACHE_SIZE;
+            outAesKey = &entry.m_aesKey;
+            return 0;
+        }
+    }
+    uint8_t userKey[32] = {};
+    if (uECC_shared_secret(clientPublicKey, m_serverPrivateKey, userKey, uECC_secp256k1()) == 0) {
+        return -1;
+    }
+    // replace the entry after last used one, round robin
+    m_lastAesKeyIndex = (m_lastAesKeyIndex + 1) % AES_KEY_CACHE_SIZE;
+    AesKeyCacheEntry &entry = m_aesKeyCache[m_lastAesKeyIndex];
+    entry.m_valid = false;
+    if (AES_set_encrypt_key(userKey, AES_KEY_BITSET_LEN, &entry.m_aesKey) != 0) {
+        return -2;
+    }
+    memcpy(entry.m_clientPublicKey, clientPublicKey, ECC_PUBLIC_KEY_LEN);
+    entry.m_valid = true;
+    outAesKey = &entry.m_aesKey;
+    return 0;
+}
+
 ModeSet toModeSet(GlogByte_t value) {
     ModeSet st{};
-    st.m_compressMode = static_cast<GlogCompressMode>(value >> 4);
+    st.m_compressMode = static_cast<GlogCompressMode>((value >> 4) & 0x03);
     st.m_encryptMode = static_cast<GlogEncryptMode>(value & 0x0F);
+    st.m_chunkType = static_cast<GlogChunkType>(value >> 6);
     return st;
 }
 
 GlogByte_t fromModeSet(const ModeSet st) {
     auto compressMode = static_cast<uint8_t>(st.m_compressMode);
     auto encryptMode = static_cast<uint8_t>(st.m_encryptMode);
-    return encryptMode | compressMode << 4;
+    auto chunkType = static_cast<uint8_t>(st.m_chunkType);
+    return encryptMode | compressMode << 4 | chunkType << 6;
 }
 
 uint32_t logStoreSize(GlogBufferLength_t logLength, bool cipher) {
@@ -5,6 +5,8 @@
 #include "MessageQueue.h"
 #include "InternalLog.h"
 #include "ScopedLock.h"
+#include "utilities.h"
+#include <algorithm>
 #include <cerrno>
 #include <memory>
 #include <thread>
@@ -12,7 +14,31 @@
 
 namespace glog {
 
-MessageQueue::MessageQueue(int capacity) : m_capacity(capacity), m_queueLock(new ThreadLock) {
+MessageQueue::MessageQueue(size_t capacity,
+                           WriteBatchHandler writeBatchHandler,
+                           WriteChunkHandler writeChunkHandler,
+                           ReleaseHandler releaseHandler,
+                           ControlHandler controlHandler,
+                           WriterExecutor *executor)
+    : m_ring(capacity)
+    , m_queueLock(new ThreadLock)
+    , m_workerParked(false)
+    , m_parkedProducers(0)
+    , m_writeBatchHandler(std::move(writeBatchHandler))
+    , m_writeChunkHandler(std::move(writeChunkHandler))
+    , m_releaseHandler(std::move(releaseHandler))
+    , m_controlHandler(std::move(controlHandler))
+    , m_nextTicket(1)
+    , m_handledTicket(0)
+    , m_batch(new Message[MESSAGE_QUEUE_BATCH_SIZE])
+    , m_batchLogs(new struct iovec[MESSAGE_QUEUE_BATCH_SIZE])
+    , m_executor(executor)
+    , m_scheduled(false) {
+    // set before worker start, worker may exit immediately if it reads false
+    m_running = true;
+    if (m_executor) {
+        return;
+    }
     // start looper immediately
     pthread_attr_t attr;
     pthread_attr_init(&attr);
@@ -20,23 +46,33 @@ MessageQueue::MessageQueue(int capacity) : m_capacity(capacity), m_queueLock(new
     if (ret != 0) {
         InternalError("fail to create thread, message queue quit. %s", ::strerror(errno));
         m_running = false;
-    } else {
-        m_running = true;
     }
     pthread_attr_destroy(&attr);
 }
 
 MessageQueue::~MessageQueue() {
     quit();
-    ::pthread_join(m_worker, nullptr);
-    {
+    if (m_executor) {
+        // wait for the executor to finish pending messages and leave this queue
         SCOPED_LOCK(m_queueLock);
 
-        std::list<std::unique_ptr<Message>> empty;
-        std::swap(m_queue, empty);
+        while (m_scheduled) {
+            m_queueIdleCondition.await(*m_queueLock);
+        }
+    } else {
+        ::pthread_join(m_worker, nullptr);
+    }
+    // worker is gone, give context of left control messages back so nothing waits or leaks
+    Message discard;
+    while (m_ring.pop(discard)) {
+        if (discard.isControl()) {
+            handleControl(discard, true);
+        }
     }
 
     delete m_queueLock;
+    delete[] m_batch;
+    delete[] m_batchLogs;
 }
 
 void *MessageQueue::workerRunnable(void *mqPtr) {
@@ -49,9 +85,8 @@ void *MessageQueue::workerRunnable(void *mqPtr) {
         InternalWarning("fail to set mq thread name, %s", strerror(errno));
     }
     auto *ptr = (MessageQueue *) (mqPtr);
-    if (ptr->m_running) {
-        ptr->loop();
-    }
+    // quit may come before the thread runs, loop still drains messages enqueued till then
+    ptr->loop();
     return nullptr;
 }
 
@@ -71,40 +106,229 @@ void MessageQueue::loop() {
 #endif
 
     while (true) {
-        std::unique_ptr<Message> msg;
-        {
-            SCOPED_LOCK(m_queueLock);
+        if (drainOnce() > 0) {
+            continue;
+        }
 
-            if (m_running && m_queue.empty()) {
-                m_queueNotEmptyCondition.await(*m_queueLock);
-            }
+        SCOPED_LOCK(m_queueLock);
 
-            if (!m_running && m_queue.empty()) { // quit -> complete all task -> exit loop
+        m_workerParked = true;
+        // pairs with the fence in enqueue(), either we see the new message or the producer sees us parked
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_ring.empty()) {
+            if (!m_running) { // quit -> complete all task -> exit loop
+                m_workerParked = false;
                 break;
             }
-            msg = std::move(m_queue.front());
-            m_queue.pop_front();
+            m_queueNotEmptyCondition.await(*m_queueLock);
+        }
+        m_workerParked = false;
+    }
+}
+
+size_t MessageQueue::drainOnce() {
+    // take out all pending messages (at most one batch) without lock
+    size_t num = 0;
+    while (num < MESSAGE_QUEUE_BATCH_SIZE && m_ring.pop(m_batch[num])) {
+        num++;
+    }
+    if (num > 0) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // wake up waiting producers after half of the ring drained, not on every pop
+        if (m_parkedProducers.load() > 0 && m_ring.size() <= m_ring.capacity() / 2) {
+            SCOPED_LOCK(m_queueLock);
+            m_queueNotFullCondition.broadcast();
+        }
+        dispatch(num);
+    }
+    return num;
+}
+
+void MessageQueue::runScheduled() {
+    drainOnce();
+
+    // one batch at a time, let the executor pick the deepest queue again
+    if (!m_ring.empty()) {
+        m_executor->schedule(this);
+        return;
+    }
+
+    SCOPED_LOCK(m_queueLock);
+
+    m_scheduled = false;
+    // pairs with the exchange in enqueue(), either we see the new message or the producer sees us idle
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!m_ring.empty() && !m_scheduled.exchange(true)) {
+        m_executor->schedule(this);
+        return;
+    }
+    // this queue may be destroyed once the lock released
+    m_queueIdleCondition.broadcast();
+}
+
+void MessageQueue::dispatch(size_t num) {
+    size_t logNum = 0;
+    auto flushLogs = [this, &logNum]() {
+        if (logNum == 0) {
+            return;
+        }
+        m_writeBatchHandler(m_batchLogs, logNum);
+        for (size_t i = 0; i < logNum; ++i) {
+            m_releaseHandler(m_batchLogs[i].iov_base, 1, m_batchLogs[i].iov_len);
+        }
+        logNum = 0;
+    };
+    for (size_t i = 0; i < num; ++i) {
+        Message &msg = m_batch[i];
+        switch (msg.m_type) {
+            case MessageType::Write:
+                m_batchLogs[logNum].iov_base = msg.m_log;
+                m_batchLogs[logNum].iov_len = msg.m_logLength;
+                logNum++;
+                break;
+            case MessageType::WriteBatch:
+                flushLogs();
+                m_writeBatchHandler(static_cast<struct iovec *>(msg.m_log), msg.m_logNum);
+                m_releaseHandler(msg.m_log, msg.m_logNum, msg.m_logLength);
+                break;
+            case MessageType::WriteChunk:
+                flushLogs();
+                m_writeChunkHandler(msg.m_log, msg.m_logLength, static_cast<format::GlogChunkType>(msg.m_flags),
+                                    msg.m_wholeLength);
+                m_releaseHandler(msg.m_log, 1, msg.m_logLength);
+                break;
+            case MessageType::Flush:
+            case MessageType::RemoveAll:
+            case MessageType::Barrier:
+                flushLogs();
+                handleControl(msg, false);
+                break;
+            case MessageType::None:
+                break;
+        }
+        msg = Message();
+    }
+    flushLogs();
+}
+
+void MessageQueue::markHandled(uint64_t ticket) {
+    SCOPED_LOCK(m_queueLock);
+
+    m_handledTicket = std::max(m_handledTicket, ticket);
+    m_handledCondition.broadcast();
+}
+
+void MessageQueue::handleControl(const Message &msg, bool dropped) {
+    if (msg.m_type != MessageType::Barrier) {
+        m_controlHandler(msg.m_type, msg.m_flags, msg.m_context, dropped);
+    }
+    markHandled(msg.m_ticket);
+}
+
+uint64_t MessageQueue::enqueueControl(MessageType type, uint32_t flags, void *context) {
+    SCOPED_LOCK(&m_controlLock);
+
+    uint64_t ticket = m_nextTicket;
+    if (!enqueue(Message(type, flags, ticket, context))) {
+        return 0;
+    }
+    m_nextTicket++;
+    return ticket;
+}
+
+bool MessageQueue::awaitHandled(uint64_t ticket, long timeoutMillis) {
+    if (ticket == 0) {
+        return false;
+    }
+    int64_t deadline = cycleClockNow() + timeoutMillis * 1000;
+    SCOPED_LOCK(m_queueLock);
+
+    while (m_handledTicket < ticket) {
+        if (timeoutMillis < 0) {
+            m_handledCondition.await(*m_queueLock);
+            continue;
+        }
+        long remainMillis = static_cast<long>((deadline - cycleClockNow()) / 1000);
+        if (remainMillis <= 0 || !m_handledCondition.awaitTimeout(*m_queueLock, remainMillis)) {
+            return m_handledTicket >= ticket;
         }
-        msg->m_callback();
     }
+    return true;
 }
 
 bool MessageQueue::enqueue(Message &&msg) {
     if (!m_running) {
         return false;
     }
-    SCOPED_LOCK(m_queueLock);
 
-    if (m_queue.size() >= m_capacity) {
-        InternalWarning("mq reach capacity:%d", m_capacity);
+    while (!m_ring.push(msg)) {
+        // ring is full, wait for the worker to drain instead of growing without limit
+        if (!awaitRoom(1)) {
+            return false;
+        }
+    }
+    notifyWorker();
+    return true;
+}
+
+bool MessageQueue::enqueueBulk(Message *msgs, size_t num) {
+    if (!m_running || num > m_ring.capacity()) {
         return false;
     }
-    m_queue.emplace_back(msg.move());
-    m_queueNotEmptyCondition.signal();
 
+    while (!m_ring.pushBulk(msgs, num)) {
+        if (!awaitRoom(num)) {
+            return false;
+        }
+    }
+    notifyWorker();
+    return true;
+}
+
+bool MessageQueue::awaitRoom(size_t num) {
+    SCOPED_LOCK(m_queueLock);
+
+    if (!m_running) {
+        return false;
+    }
+    m_parkedProducers++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!m_ring.hasRoom(num)) {
+        InternalDebug("mq reach capacity:%zu", m_ring.capacity());
+        m_queueNotFullCondition.await(*m_queueLock);
+    }
+    m_parkedProducers--;
     return true;
 }
 
+void MessageQueue::notifyWorker() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_executor) {
+        if (!m_scheduled.exchange(true)) {
+            m_executor->schedule(this);
+        }
+    } else if (m_workerParked) {
+        SCOPED_LOCK(m_queueLock);
+        m_queueNotEmptyCondition.signal();
+    }
+}
+
+size_t MessageQueue::dropOldest(size_t bytes, const ReleaseHandler &dropHandler) {
+    size_t dropped = 0;
+    // ring is MPMC safe, pop from producer side is ok. control message keeps its place against writes
+    Message msg;
+    auto droppable = [](const Message &head) { return head.isWrite() && head.m_type != MessageType::WriteChunk; };
+    while (dropped < bytes && m_ring.popIf(msg, droppable)) {
+        dropHandler(msg.m_log, msg.m_type == MessageType::WriteBatch ? msg.m_logNum : 1, msg.m_logLength);
+        dropped += msg.m_logLength;
+    }
+    if (dropped > 0 && m_parkedProducers.load() > 0) {
+        SCOPED_LOCK(m_queueLock);
+        m_queueNotFullCondition.broadcast();
+    }
+    return dropped;
+}
+
 void MessageQueue::quit() {
     SCOPED_LOCK(m_queueLock);
 
@@ -112,11 +336,86 @@ void MessageQueue::quit() {
     if (m_running) {
         m_running = false;
         m_queueNotEmptyCondition.signal();
+        m_queueNotFullCondition.broadcast();
+    }
+}
+
+WriterExecutor::WriterExecutor(size_t workerNum)
+    : m_workers(new pthread_t[workerNum > 0 ? workerNum : 1]), m_workerNum(0), m_running(true) {
+    m_readyQueues.reserve(16);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    for (size_t i = 0; i < std::max<size_t>(workerNum, 1); ++i) {
+        int ret = ::pthread_create(&m_workers[m_workerNum], &attr, workerRunnable, this);
+        if (ret != 0) {
+            InternalError("fail to create shared writer thread. %s", ::strerror(errno));
+            continue;
+        }
+        m_workerNum++;
+    }
+    pthread_attr_destroy(&attr);
+}
+
+WriterExecutor::~WriterExecutor() {
+    {
+        SCOPED_LOCK(&m_lock);
+        m_running = false;
+        m_readyCondition.broadcast();
+    }
+    for (size_t i = 0; i < m_workerNum; ++i) {
+        ::pthread_join(m_workers[i], nullptr);
+    }
+    delete[] m_workers;
+}
+
+void WriterExecutor::schedule(MessageQueue *queue) {
+    SCOPED_LOCK(&m_lock);
+
+    m_readyQueues.push_back(queue);
+    m_readyCondition.signal();
+}
+
+void *WriterExecutor::workerRunnable(void *executorPtr) {
+#ifdef GLOG_ANDROID
+    int ret = ::pthread_setname_np(::pthread_self(), SHARED_WRITER_THREAD_NAME);
+#else
+    int ret = ::pthread_setname_np(SHARED_WRITER_THREAD_NAME);
+#endif
+    if (ret != 0) {
+        InternalWarning("fail to set shared writer thread name, %s", strerror(errno));
     }
+    static_cast<WriterExecutor *>(executorPtr)->loop();
+    return nullptr;
 }
 
-std::unique_ptr<Message> Message::move() {
-    return std::make_unique<Message>(std::move(*this));
+void WriterExecutor::loop() {
+    while (true) {
+        MessageQueue *queue;
+        {
+            SCOPED_LOCK(&m_lock);
+
+            while (m_running && m_readyQueues.empty()) {
+                m_readyCondition.await(m_lock);
+            }
+            if (m_readyQueues.empty()) { // quit
+                break;
+            }
+            // favour the deepest backlog
+            size_t picked = 0;
+            size_t maxPending = 0;
+            for (size_t i = 0; i < m_readyQueues.size(); ++i) {
+                size_t pending = m_readyQueues[i]->m_ring.size();
+                if (pending > maxPending) {
+                    maxPending = pending;
+                    picked = i;
+                }
+            }
+            queue = m_readyQueues[picked];
+            m_readyQueues[picked] = m_readyQueues.back();
+            m_readyQueues.pop_back();
+        }
+        queue->runScheduled();
+    }
 }
 
-} // namespace glog
\ No newline at end of file
+} // namespace glog
@@ -5,56 +5,425 @@
 #ifndef CORE__MESSAGEQUEUE_H_
 #define CORE__MESSAGEQUEUE_H_
 
+#include "GlogPredef.h"
 #include "ThreadLock.h"
-#include <condition_variable>
+#include <atomic>
 #include <functional>
-#include <list>
-#include <mutex>
+#include <memory>
+#include <sys/uio.h>
 #include <thread>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace glog {
 
 class Message;
+class MessageQueue;
+
+enum class MessageType : uint8_t {
+    None = 0,
+    Write = 1,      // one log in pooled storage
+    WriteBatch = 2, // logs copied into one pooled block
+    Flush = 3,
+    RemoveAll = 4,
+    Barrier = 5, // nothing to do, handled means all messages before it are handled
+    WriteChunk = 6, // one chunk of a long log in pooled storage, chunks of a log are next to each other in ring
+};
+
+/**
+ * bounded multi-producer ring, every slot carries a sequence number (Dmitry Vyukov's bounded queue),
+ * so producers only contend on one CAS of the enqueue position and never take a lock.
+ * capacity will be round up to power of 2.
+ */
+template <typename T>
+class MpscRing {
+public:
+    explicit MpscRing(size_t capacity) : m_mask(roundUpPowerOf2(capacity) - 1), m_cells(new Cell[m_mask + 1]) {
+        for (size_t i = 0; i <= m_mask; ++i) {
+            m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+        }
+        m_enqueuePos.store(0, std::memory_order_relaxed);
+        m_dequeuePos.store(0, std::memory_order_relaxed);
+    }
+
+    ~MpscRing() { delete[] m_cells; }
+
+    /**
+     * return false if ring is full, value will NOT be moved in that case
+     */
+    bool push(T &value) {
+        Cell *cell;
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->m_sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->m_data = std::move(value);
+        cell->m_sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * return false if ring is empty
+     */
+    /**
+     * push num values into consecutive slots with one claim, so values of other producers never come in between.
+     * return false if ring has no room for all of them, values will NOT be moved in that case
+     */
+    bool pushBulk(T *values, size_t num) {
+        if (num > m_mask + 1) {
+            return false;
+        }
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            intptr_t diff = 0;
+            for (size_t i = 0; i < num && diff == 0; ++i) {
+                size_t seq = m_cells[(pos + i) & m_mask].m_sequence.load(std::memory_order_acquire);
+                diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + i);
+            }
+            if (diff == 0) {
+                // slots between pos and pos + num are only touched by the one who moves enqueue position over them
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + num, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        for (size_t i = 0; i < num; ++i) {
+            Cell *cell = &m_cells[(pos + i) & m_mask];
+            cell->m_data = std::move(values[i]);
+            cell->m_sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        return true;
+    }
+
+    bool pop(T &outValue) {
+        Cell *cell;
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->m_sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        outValue = std::move(cell->m_data);
+        cell->m_sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * pop only if predicate accepts the oldest element, return false if ring is empty or it's not accepted.
+     * T must be trivially copyable, it's copied before the claim and the copy is checked not overwritten after.
+     */
+    template <typename Predicate>
+    bool popIf(T &outValue, Predicate predicate) {
+        Cell *cell;
+        T candidate;
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->m_sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                candidate = cell->m_data;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                // slot is only reused after it's popped, same sequence means the copy is intact
+                if (cell->m_sequence.load(std::memory_order_relaxed) != seq) {
+                    pos = m_dequeuePos.load(std::memory_order_relaxed);
+                    continue;
+                }
+                if (!predicate(candidate)) {
+                    return false;
+                }
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        outValue = candidate;
+        cell->m_sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        return m_cells[pos & m_mask].m_sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    bool full() const { return !hasRoom(1); }
+
+    // approximate, whether num more elements can be pushed now
+    bool hasRoom(size_t num) const {
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed) + num - 1;
+        return m_cells[pos & m_mask].m_sequence.load(std::memory_order_acquire) == pos;
+    }
+
+    // approximate number of elements, for statistics only
+    size_t size() const {
+        size_t enqueuePos = m_enqueuePos.load(std::memory_order_relaxed);
+        size_t dequeuePos = m_dequeuePos.load(std::memory_order_relaxed);
+        return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+    // just forbid it for possibly misuse
+    MpscRing(const MpscRing &other) = delete;
+    MpscRing &operator=(const MpscRing &other) = delete;
+
+private:
+    struct alignas(CACHE_LINE_SIZE) Cell {
+        std::atomic_size_t m_sequence;
+        T m_data;
+    };
+
+    static size_t roundUpPowerOf2(size_t value) {
+        size_t result = 2;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    const size_t m_mask;
+    Cell *const m_cells;
+    // producers and consumer update positions on different cache lines
+    alignas(CACHE_LINE_SIZE) std::atomic_size_t m_enqueuePos;
+    alignas(CACHE_LINE_SIZE) std::atomic_size_t m_dequeuePos;
+};
+
+/**
+ * handle consecutive write messages drained by worker, logs are only valid during the call
+ */
+typedef std::function<void(const struct iovec *logs, size_t num)> WriteBatchHandler;
+
+/**
+ * handle one chunk of a long log drained by worker, logLength is length of the whole log. chunk is only valid during
+ * the call
+ */
+typedef std::function<void(const void *chunk, size_t length, format::GlogChunkType chunkType, size_t logLength)>
+    WriteChunkHandler;
+
+/**
+ * give back memory of a write message after it is written or dropped, it carries num logs of bytes content
+ */
+typedef std::function<void(void *block, size_t num, size_t bytes)> ReleaseHandler;
+
+/**
+ * handle flush and remove all message in worker. context is the one passed to enqueueControl,
+ * dropped is true if the message is discarded without running because queue quit.
+ */
+typedef std::function<void(MessageType type, uint32_t flags, void *context, bool dropped)> ControlHandler;
+
+/**
+ * worker threads shared by multiple message queues, a queue is drained by at most one worker at a time
+ * so messages of one queue keep FIFO order. ready queue with more pending messages is served first.
+ */
+class WriterExecutor {
+public:
+    explicit WriterExecutor(size_t workerNum);
+
+    // all queues attached MUST be destroyed before
+    ~WriterExecutor();
+
+    // put queue into ready list, called when queue turns from idle to scheduled
+    void schedule(MessageQueue *queue);
+
+    size_t getWorkerNum() const { return m_workerNum; }
+
+    // just forbid it for possibly misuse
+    WriterExecutor(const WriterExecutor &other) = delete;
+    WriterExecutor &operator=(const WriterExecutor &other) = delete;
+
+private:
+    std::vector<MessageQueue *> m_readyQueues; // guide by m_lock
+    ThreadLock m_lock;
+    ConditionVariable m_readyCondition;
+    pthread_t *m_workers;
+    size_t m_workerNum;
+    bool m_running; // guide by m_lock
+    void loop();
+
+    // entrance of worker thread
+    static void *workerRunnable(void *executorPtr);
+};
 
 class MessageQueue {
+    friend class WriterExecutor;
+
 public:
-    explicit MessageQueue(int capacity);
+    /**
+     * @param executor run by shared executor if not null, or by a dedicated worker thread
+     */
+    MessageQueue(size_t capacity,
+                 WriteBatchHandler writeBatchHandler,
+                 WriteChunkHandler writeChunkHandler,
+                 ReleaseHandler releaseHandler,
+                 ControlHandler controlHandler,
+                 WriterExecutor *executor = nullptr);
     bool enqueue(Message &&msg);
+
+    /**
+     * enqueue chunk messages of one long log with one reservation, they are drained next to each other.
+     * return false if queue quit or num exceeds capacity.
+     */
+    bool enqueueBulk(Message *msgs, size_t num);
+
+    /**
+     * enqueue flush, remove all or barrier message, return its ticket for awaitHandled, 0 if queue quit.
+     * once enqueued, context is handed to ControlHandler exactly once, either handled or dropped.
+     */
+    uint64_t enqueueControl(MessageType type, uint32_t flags = 0, void *context = nullptr);
+
+    /**
+     * wait until control message of ticket is handled, wait forever if timeoutMillis < 0.
+     * return false if timeout or ticket is 0.
+     */
+    bool awaitHandled(uint64_t ticket, long timeoutMillis);
+
+    /**
+     * remove oldest write messages until dropped length >= bytes, called by producers. stop at a control message,
+     * writes behind it are never dropped or reordered before it. stop at a chunk too, a long log is never cut.
+     * dropped ones go to dropHandler instead of releaseHandler. return dropped length.
+     */
+    size_t dropOldest(size_t bytes, const ReleaseHandler &dropHandler);
+
     void quit();
     bool isRunning() const { return m_running; }
     ~MessageQueue();
 
 private:
-    std::list<std::unique_ptr<Message>> m_queue;
-    int m_capacity;
+    MpscRing<Message> m_ring;
     pthread_t m_worker;
     ThreadLock *m_queueLock;
     ConditionVariable m_queueNotEmptyCondition;
+    ConditionVariable m_queueNotFullCondition;
     std::atomic_bool m_running;
+    // wakeup coalescing, only signal the other side when it is actually parked
+    std::atomic_bool m_workerParked;
+    std::atomic_int m_parkedProducers;
+    const WriteBatchHandler m_writeBatchHandler;
+    const WriteChunkHandler m_writeChunkHandler;
+    const ReleaseHandler m_releaseHandler;
+    const ControlHandler m_controlHandler;
+    // control messages enter ring in ticket order, so handled tickets only grow
+    ThreadLock m_controlLock;
+    uint64_t m_nextTicket;    // guide by m_controlLock
+    uint64_t m_handledTicket; // guide by m_queueLock
+    ConditionVariable m_handledCondition;
+    // only touched by worker thread
+    Message *m_batch;
+    struct iovec *m_batchLogs;
+    WriterExecutor *const m_executor;
+    // in ready list of executor or being drained by one of its workers
+    std::atomic_bool m_scheduled;
+    ConditionVariable m_queueIdleCondition;
     void loop();
 
+    // wait until ring may have room for num messages, return false if queue quit
+    bool awaitRoom(size_t num);
+
+    // wake up worker for messages just pushed
+    void notifyWorker();
+
+    // pop at most one batch and run it, return number of messages
+    size_t drainOnce();
+
+    // run drained messages in order, consecutive writes go to m_writeBatchHandler together
+    void dispatch(size_t num);
+
+    // called by executor's worker, drain one batch then schedule again if still pending
+    void runScheduled();
+
+    // wake up threads waiting for ticket
+    void markHandled(uint64_t ticket);
+
+    // hand control message to m_controlHandler and wake up its waiters
+    void handleControl(const Message &msg, bool dropped);
+
     // entrance of worker thread
     static void *workerRunnable(void *mqPtr);
 };
 
+/**
+ * compact record carried by the queue, trivially copyable so passing it through the ring never allocates
+ */
 class Message {
     friend class MessageQueue;
 
 public:
-    explicit Message(std::function<void()> callback) { m_callback = std::move(callback); }
+    Message() = default;
 
-    std::unique_ptr<Message> move();
+    // write message, log is handed to ReleaseHandler after written
+    Message(void *log, size_t length) : m_type(MessageType::Write), m_log(log), m_logLength(length) {}
 
-    Message(const Message &) = delete;
-    Message &operator=(const Message &) = delete;
+    /**
+     * batch write message, the block starts with iovec array of num logs, followed by their content.
+     * block is handed to ReleaseHandler after written.
+     */
+    Message(struct iovec *block, size_t num, size_t bytes)
+        : m_type(MessageType::WriteBatch), m_log(block), m_logLength(bytes), m_logNum(num) {}
 
-    Message(Message &&) = default;
-    Message &operator=(Message &&) = default;
+    // chunk write message of a log of logLength, chunk is handed to ReleaseHandler after written
+    Message(void *chunk, size_t length, format::GlogChunkType chunkType, size_t logLength)
+        : m_type(MessageType::WriteChunk)
+        , m_flags(static_cast<uint32_t>(chunkType))
+        , m_log(chunk)
+        , m_logLength(length)
+        , m_wholeLength(logLength) {}
 
 private:
-    std::function<void()> m_callback;
+    // control message, created by MessageQueue::enqueueControl
+    Message(MessageType type, uint32_t flags, uint64_t ticket, void *context)
+        : m_type(type), m_flags(flags), m_context(context), m_ticket(ticket) {}
+
+    bool isWrite() const {
+        return m_type == MessageType::Write || m_type == MessageType::WriteBatch || m_type == MessageType::WriteChunk;
+    }
+
+    bool isControl() const { return !isWrite() && m_type != MessageType::None; }
+
+    MessageType m_type = MessageType::None;
+    uint32_t m_flags = 0; // chunk type of chunk write, or control message flags which meaning is up to ControlHandler
+    union {
+        void *m_log = nullptr; // log of write, block of batch write, chunk of chunk write
+        void *m_context;       // control message, passed to ControlHandler
+    };
+    size_t m_logLength = 0; // content bytes of write, batch write and chunk write
+    union {
+        size_t m_logNum = 0;   // batch write
+        size_t m_wholeLength; // chunk write, length of the log it belongs to
+        uint64_t m_ticket;     // control message
+    };
 };
 
+static_assert(std::is_trivially_copyable<Message>::value, "message is copied through ring");
+
 } // namespace glog
 #endif //CORE__MESSAGEQUEUE_H_
@@ -90,6 +90,13 @@ void ConditionVariable::signal() {
     }
 }
 
+void ConditionVariable::broadcast() {
+    int ret = pthread_cond_broadcast(&m_condition);
+    if (ret != 0) {
+        InternalError("fail to broadcast %p, ret=%d, errno=%s", &m_condition, ret, strerror(errno));
+    }
+}
+
 void ConditionVariable::makeTimeout(struct timespec *pts, long millisecond) {
     struct timeval tv {};
     gettimeofday(&tv, nullptr);
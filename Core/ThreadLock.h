@@ -37,6 +37,7 @@ public:
     ~ConditionVariable();
 
     void signal();
+    void broadcast();
     void await(ThreadLock &lock);
     /**
      * return false if timeout
@@ -17,7 +17,7 @@ bool ZlibCompressor::realCompress(const GlogBuffer &inBuffer, GlogBuffer &outBuf
     m_stream.next_out = static_cast<Bytef *>(outBuffer.getPtr());
     m_stream.avail_out = outBuffer.getCapacity();
 
-    int ret = deflate(&m_stream, Z_SYNC_FLUSH);
+    int ret = deflate(&m_stream, m_flushMode);
 
     if (ret != Z_OK) {
         InternalError("fail to zlib deflate, ret:%d", ret);
@@ -36,6 +36,11 @@ void ZlibCompressor::reset() {
     }
 }
 
+size_t ZlibCompressor::compressBound(size_t length) {
+    // deflateBound assumes Z_FINISH, Z_SYNC_FLUSH (Z_FULL_FLUSH) may append an empty stored block (~6 bytes)
+    return deflateBound(&m_stream, length) + 6;
+}
+
 bool ZlibDecompressor::realDecompress(const GlogBuffer &inBuffer, GlogBuffer &outBuffer) {
     m_stream.avail_in = inBuffer.getAvailLength();
     m_stream.next_in = static_cast<Bytef *>(inBuffer.getPtr());
@@ -46,7 +51,8 @@ bool ZlibDecompressor::realDecompress(const GlogBuffer &inBuffer, GlogBuffer &ou
     int ret = inflate(&m_stream, Z_SYNC_FLUSH);
 
     if (ret != Z_OK) {
-        InternalError("fail to zlib inflate, ret:%d, msg:%s", ret, m_stream.msg);
+        // caller reports with file and position, a failure is expected while looking for a stream start
+        InternalDebug("fail to zlib inflate, ret:%d, msg:%s", ret, m_stream.msg);
         outBuffer.setAvailLength(0);
         return false;
     }
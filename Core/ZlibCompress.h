@@ -12,7 +12,13 @@
 namespace glog {
 class ZlibCompressor : public Compressor {
 public:
-    ZlibCompressor() : Compressor(), m_stream(z_stream{.zalloc = Z_NULL, .zfree = Z_NULL, .opaque = Z_NULL}) {
+    /**
+     * @param fullFlush every output is decodable without previous ones (Z_FULL_FLUSH), costs compress ratio
+     */
+    explicit ZlibCompressor(bool fullFlush = false)
+        : Compressor()
+        , m_stream(z_stream{.zalloc = Z_NULL, .zfree = Z_NULL, .opaque = Z_NULL})
+        , m_flushMode(fullFlush ? Z_FULL_FLUSH : Z_SYNC_FLUSH) {
         // windowBits can also be -8..-15 for raw deflate. In this case, -windowBits determines the window size.
         // deflate() will then generate raw deflate data with no zlib header or trailer, and will not compute a check value.
         int ret =
@@ -32,8 +38,11 @@ public:
 
     void reset() override;
 
+    size_t compressBound(size_t length) override;
+
 private:
     z_stream m_stream;
+    const int m_flushMode;
 };
 
 class ZlibDecompressor : public Decompressor {
@@ -0,0 +1,92 @@
+#include "Glog.h"
+#include "GlogBuffer.h"
+#include "GlogReader.h"
+#include "utilities.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace glog;
+
+namespace {
+
+const size_t CACHE_SIZE = 4 * 1024 * 1024;
+// at most about 15 archives with 64 bytes logs, under DEFAULT_TOTAL_ARCHIVE_NUM_LIMIT
+const size_t LOG_BYTES = 32 * 1024 * 1024;
+const int REPEAT = 3;
+
+struct Result {
+    double m_mbPerSecond;
+    double m_logsPerSecond;
+    size_t m_logs;
+};
+
+// logs look like real ones, zlib compresses them but not to nothing
+std::vector<string> writeArchives(Glog *instance, size_t logSize) {
+    std::string log;
+    srand(1);
+    for (size_t i = 0; i < LOG_BYTES / logSize; ++i) {
+        log = std::to_string(i) + " [main] I/benchmark: ";
+        while (log.size() < logSize) {
+            log += "abcdefghijklmnopqrstuvwxyz0123456789"[rand() % 36];
+        }
+        instance->write(GlogBuffer((void *) log.data(), log.size()));
+    }
+    std::vector<string> archives;
+    instance->getArchiveSnapshot(archives, ArchiveCondition{true, 0, 0}, FileOrder::CreateTimeAscending);
+    return archives;
+}
+
+Result readAll(Glog *instance, const std::vector<string> &archives) {
+    char buf[SINGLE_LOG_CONTENT_MAX_LENGTH];
+    size_t logs = 0, bytes = 0;
+    int64_t begin = cycleClockNow();
+    for (int r = 0; r < REPEAT; ++r) {
+        for (const auto &archive : archives) {
+            GlogReader *reader = instance->openReader(archive);
+            while (true) {
+                GlogBuffer buffer(buf, sizeof(buf));
+                int n = reader->read(buffer);
+                if (n < 0) {
+                    break;
+                }
+                logs += n > 0;
+                bytes += n;
+            }
+            instance->closeReader(reader);
+        }
+    }
+    double seconds = (cycleClockNow() - begin) / 1e6;
+    return Result{bytes / seconds / (1024 * 1024), logs / seconds, logs / REPEAT};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Glog::initialize(InternalLogLevelWarning);
+    std::string directory = argc > 1 ? argv[1] : "/tmp/glog_archive_read_benchmark";
+
+    printf("%-10s %-6s %12s %14s %10s\n", "log size", "zlib", "MB/s", "logs/s", "logs");
+    for (size_t logSize : {64, 256, 1024}) {
+        for (bool zlib : {false, true}) {
+            system(("rm -rf " + directory).c_str());
+            GlogConfig config;
+            config.m_protoName = "benchmark";
+            config.m_rootDirectory = directory;
+            config.m_async = false;
+            config.m_compressMode = zlib ? format::GlogCompressMode::Zlib : format::GlogCompressMode::None;
+            config.m_cacheSize = CACHE_SIZE;
+            config.m_totalArchiveSizeLimit = 1024 * 1024 * 1024;
+            Glog *instance = Glog::maybeCreateWithConfig(config);
+            std::vector<string> archives = writeArchives(instance, logSize);
+            // page cache is warm for both ways of reading
+            readAll(instance, archives);
+            Result result = readAll(instance, archives);
+            Glog::destroy(config.m_protoName);
+            printf("%-10zu %-6s %12.2f %14.0f %10zu\n", logSize, zlib ? "yes" : "no", result.m_mbPerSecond,
+                   result.m_logsPerSecond, result.m_logs);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "Glog.h"
+#include "GlogBuffer.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace glog;
+
+namespace {
+
+std::atomic_bool g_counting(false);
+std::atomic_size_t g_allocations(0);
+
+// every round fits in cache, archiving is not part of steady state
+const int LOGS_PER_ROUND = 1000;
+const int ROUNDS = 20;
+
+std::string makeLog(int i) {
+    std::string log = "user click page order id=" + std::to_string(i) + " latency=" + std::to_string(i % 97) + "ms";
+    log.resize(100, ' ');
+    return log;
+}
+
+} // namespace
+
+void *operator new(size_t size) {
+    if (g_counting.load(std::memory_order_relaxed)) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    void *ptr = malloc(size > 0 ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+/**
+ * count heap allocations of async write path (producer and worker) after warm up, exit 1 if any.
+ * small memory budget keeps producer waiting for worker, so most logs are written inside counting window.
+ */
+int main(int argc, char **argv) {
+    Glog::initialize(InternalLogLevelWarning);
+    std::string directory = argc > 1 ? argv[1] : "/tmp/glog_async_allocation_benchmark";
+    system(("rm -rf " + directory).c_str());
+
+    GlogConfig config;
+    config.m_protoName = "benchmark";
+    config.m_rootDirectory = directory;
+    config.m_async = true;
+    config.m_asyncMemoryBudget = 16 * 1024;
+    config.m_overflowBlockTimeoutMillis = 60 * 1000;
+    Glog *instance = Glog::maybeCreateWithConfig(config);
+
+    std::vector<std::string> logs;
+    for (int i = 0; i < LOGS_PER_ROUND; ++i) {
+        logs.push_back(makeLog(i));
+    }
+    size_t allocations = 0;
+    size_t misses = 0;
+    for (int round = 0; round <= ROUNDS; ++round) {
+        instance->flush();
+        size_t missesBefore = instance->getStatistics().m_bufferPoolMisses;
+        g_allocations = 0;
+        g_counting = round > 0; // round 0 warms up buffer pool and cache
+        for (auto &log : logs) {
+            instance->write(GlogBuffer((void *) log.data(), log.size()));
+        }
+        g_counting = false;
+        if (round > 0) {
+            allocations += g_allocations;
+            misses += instance->getStatistics().m_bufferPoolMisses - missesBefore;
+        }
+    }
+    Glog::destroy(config.m_protoName);
+
+    printf("logs:%d heap allocations:%zu buffer pool misses:%zu\n", LOGS_PER_ROUND * ROUNDS, allocations, misses);
+    return allocations == 0 && misses == 0 ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+#include "Glog.h"
+#include "GlogBuffer.h"
+#include "GlogReader.h"
+#include "utilities.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace glog;
+
+namespace {
+
+const size_t CACHE_SIZE = 4 * 1024 * 1024;
+const size_t ARCHIVE_BYTES = 16 * 1024 * 1024;
+const size_t LOG_SIZE = 100;
+const size_t ARENA_SIZE = 256 * 1024;
+const size_t MAX_BATCH_LOGS = 4096;
+
+struct Result {
+    int64_t m_micros;
+    size_t m_calls;
+    size_t m_logs;
+};
+
+std::vector<string> writeArchives(Glog *instance) {
+    std::string log(LOG_SIZE, 'x');
+    for (size_t i = 0; i < ARCHIVE_BYTES / (LOG_SIZE + 11); ++i) {
+        instance->write(GlogBuffer((void *) log.data(), log.size()));
+    }
+    std::vector<string> archives;
+    instance->getArchiveSnapshot(archives, ArchiveCondition{true, 0, 0}, FileOrder::CreateTimeAscending);
+    return archives;
+}
+
+Result readOneByOne(Glog *instance, const std::vector<string> &archives) {
+    std::vector<uint8_t> buffer(SINGLE_LOG_CONTENT_MAX_LENGTH);
+    Result result{};
+    int64_t begin = cycleClockNow();
+    for (const auto &archive : archives) {
+        GlogReader *reader = instance->openReader(archive);
+        while (true) {
+            int n = reader->read(buffer.data(), buffer.size());
+            result.m_calls++;
+            if (n < 0) {
+                break;
+            }
+            result.m_logs += n > 0;
+        }
+        instance->closeReader(reader);
+    }
+    result.m_micros = cycleClockNow() - begin;
+    return result;
+}
+
+Result readInBatches(Glog *instance, const std::vector<string> &archives) {
+    std::vector<uint8_t> arena(ARENA_SIZE);
+    std::vector<uint32_t> offsets(MAX_BATCH_LOGS), lengths(MAX_BATCH_LOGS);
+    Result result{};
+    int64_t begin = cycleClockNow();
+    for (const auto &archive : archives) {
+        GlogReader *reader = instance->openReader(archive);
+        while (true) {
+            int n = reader->readBatch(arena.data(), arena.size(), offsets.data(), lengths.data(), MAX_BATCH_LOGS);
+            result.m_calls++;
+            if (n < 0) {
+                break;
+            }
+            result.m_logs += n;
+        }
+        instance->closeReader(reader);
+    }
+    result.m_micros = cycleClockNow() - begin;
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Glog::initialize(InternalLogLevelWarning);
+    std::string directory = argc > 1 ? argv[1] : "/tmp/glog_batch_read_benchmark";
+    system(("rm -rf " + directory).c_str());
+
+    GlogConfig config;
+    config.m_protoName = "benchmark";
+    config.m_rootDirectory = directory;
+    config.m_async = false;
+    config.m_compressMode = format::GlogCompressMode::None;
+    config.m_cacheSize = CACHE_SIZE;
+    config.m_totalArchiveSizeLimit = 1024 * 1024 * 1024;
+    Glog *instance = Glog::maybeCreateWithConfig(config);
+    std::vector<string> archives = writeArchives(instance);
+
+    printf("%-12s %12s %12s %12s\n", "read", "cost (us)", "calls", "logs");
+    for (bool batch : {false, true}) {
+        Result result = batch ? readInBatches(instance, archives) : readOneByOne(instance, archives);
+        printf("%-12s %12lld %12zu %12zu\n", batch ? "batch" : "one by one", (long long) result.m_micros,
+               result.m_calls, result.m_logs);
+    }
+    Glog::destroy(config.m_protoName);
+    return 0;
+}
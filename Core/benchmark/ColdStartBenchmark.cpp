@@ -0,0 +1,100 @@
+#include "Glog.h"
+#include "GlogBuffer.h"
+#include "utilities.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace glog;
+
+namespace {
+
+const size_t LOG_SIZE = 200;
+const int OPENS = 20;
+
+struct Result {
+    int64_t m_avg;
+    int64_t m_min;
+    int64_t m_max;
+};
+
+GlogConfig makeConfig(const std::string &directory, size_t cacheSize) {
+    GlogConfig config;
+    config.m_protoName = "benchmark" + std::to_string(cacheSize / 1024);
+    config.m_rootDirectory = directory;
+    config.m_async = false;
+    config.m_compressMode = format::GlogCompressMode::None;
+    config.m_cacheSize = cacheSize;
+    return config;
+}
+
+// fill 90% of cache, no archive
+void fillCache(const GlogConfig &config, size_t cacheSize) {
+    Glog *instance = Glog::maybeCreateWithConfig(config);
+    std::string log(LOG_SIZE, 'x');
+    const size_t logNum = cacheSize * 9 / 10 / (LOG_SIZE + 11);
+    for (size_t i = 0; i < logNum; ++i) {
+        instance->write(GlogBuffer((void *) log.data(), log.size()));
+    }
+    Glog::destroy(config.m_protoName);
+}
+
+// cache written by a version without checkpoint
+void breakCheckpoint(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDWR);
+    uint8_t byte = 0;
+    off_t offset = static_cast<off_t>(getFileSize(path) - 1);
+    ::pread(fd, &byte, 1, offset);
+    byte ^= 0xff;
+    ::pwrite(fd, &byte, 1, offset);
+    ::close(fd);
+}
+
+/**
+ * microseconds to create instance on a full cache left by last run
+ */
+Result run(const std::string &directory, size_t cacheSize, bool checkpoint) {
+    GlogConfig config = makeConfig(directory, cacheSize);
+    fillCache(config, cacheSize);
+    const std::string cachePath = directory + "/" + config.m_protoName + ".glogmmap";
+
+    std::vector<int64_t> costs;
+    for (int i = 0; i < OPENS; ++i) {
+        if (!checkpoint) {
+            breakCheckpoint(cachePath);
+        }
+        int64_t begin = cycleClockNow();
+        Glog::maybeCreateWithConfig(config);
+        costs.push_back(cycleClockNow() - begin);
+        Glog::destroy(config.m_protoName);
+    }
+    int64_t total = 0;
+    for (int64_t cost : costs) {
+        total += cost;
+    }
+    return Result{total / OPENS, *std::min_element(costs.begin(), costs.end()),
+                  *std::max_element(costs.begin(), costs.end())};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Glog::initialize(InternalLogLevelWarning);
+    std::string directory = argc > 1 ? argv[1] : "/tmp/glog_cold_start_benchmark";
+
+    printf("%-12s %-12s %10s %10s %10s\n", "cache", "load", "avg (us)", "min (us)", "max (us)");
+    for (size_t cacheSize : {256 * 1024, 1024 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024}) {
+        for (bool checkpoint : {false, true}) {
+            system(("rm -rf " + directory).c_str());
+            Result result = run(directory, cacheSize, checkpoint);
+            printf("%-12s %-12s %10lld %10lld %10lld\n", (std::to_string(cacheSize / 1024) + "KB").c_str(),
+                   checkpoint ? "checkpoint" : "scan", (long long) result.m_avg, (long long) result.m_min,
+                   (long long) result.m_max);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "Glog.h"
+#include "GlogBuffer.h"
+#include "GlogReader.h"
+#include "utilities.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace glog;
+
+namespace {
+
+const std::string SERVER_PUBLIC_KEY = "41B5F5F9A53684A1C09B931B7BDF7D7C3959BC7FB31827ADBE1524DDC8F2D90AD4978891385D956C"
+                                      "E817B293FC57CF07A4EC3DAF03F63852D75A32A956B84176";
+const std::string SERVER_PRIVATE_KEY = "9C8B23A406216B7B93AA94C66AA5451CCE41DD57A8D5ADBCE8D9F1E7F3D33F45";
+const size_t CACHE_SIZE = 2 * 1024 * 1024;
+// at most about 10 archives with 64 bytes logs, under DEFAULT_TOTAL_ARCHIVE_NUM_LIMIT
+const size_t LOG_BYTES = 8 * 1024 * 1024;
+
+struct Result {
+    double m_mbPerSecond;
+    double m_logsPerSecond;
+    size_t m_logs;
+};
+
+// every flush loads cache again with a new client key pair
+std::vector<string> writeArchives(Glog *instance, size_t logSize) {
+    std::string log(logSize, 'x');
+    for (size_t i = 0; i < LOG_BYTES / logSize; ++i) {
+        instance->write(GlogBuffer((void *) log.data(), log.size()));
+    }
+    std::vector<string> archives;
+    instance->getArchiveSnapshot(archives, ArchiveCondition{true, 0, 0}, FileOrder::CreateTimeAscending);
+    return archives;
+}
+
+Result readAll(Glog *instance, const std::vector<string> &archives) {
+    char buf[SINGLE_LOG_CONTENT_MAX_LENGTH];
+    size_t logs = 0, bytes = 0;
+    int64_t begin = cycleClockNow();
+    for (const auto &archive : archives) {
+        GlogReader *reader = instance->openReader(archive, &SERVER_PRIVATE_KEY);
+        while (true) {
+            GlogBuffer buffer(buf, sizeof(buf));
+            int n = reader->read(buffer);
+            if (n < 0) {
+                break;
+            }
+            logs += n > 0;
+            bytes += n;
+        }
+        instance->closeReader(reader);
+    }
+    double seconds = (cycleClockNow() - begin) / 1e6;
+    return Result{bytes / seconds / (1024 * 1024), logs / seconds, logs};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Glog::initialize(InternalLogLevelWarning);
+    std::string directory = argc > 1 ? argv[1] : "/tmp/glog_encrypted_read_benchmark";
+
+    printf("%-10s %-6s %12s %14s %10s\n", "log size", "zlib", "MB/s", "logs/s", "logs");
+    for (size_t logSize : {64, 256, 1024}) {
+        for (bool zlib : {false, true}) {
+            system(("rm -rf " + directory).c_str());
+            std::string publicKey = SERVER_PUBLIC_KEY;
+            GlogConfig config;
+            config.m_protoName = "benchmark";
+            config.m_rootDirectory = directory;
+            config.m_async = false;
+            config.m_compressMode = zlib ? format::GlogCompressMode::Zlib : format::GlogCompressMode::None;
+            config.m_encryptMode = format::GlogEncryptMode::AES;
+            config.m_serverPublicKey = &publicKey;
+            config.m_cacheSize = CACHE_SIZE;
+            config.m_totalArchiveSizeLimit = 1024 * 1024 * 1024;
+            Glog *instance = Glog::maybeCreateWithConfig(config);
+            std::vector<string> archives = writeArchives(instance, logSize);
+            Result result = readAll(instance, archives);
+            Glog::destroy(config.m_protoName);
+            printf("%-10zu %-6s %12.2f %14.0f %10zu\n", logSize, zlib ? "yes" : "no", result.m_mbPerSecond,
+                   result.m_logsPerSecond, result.m_logs);
+        }
+    }
+    return 0;
+}
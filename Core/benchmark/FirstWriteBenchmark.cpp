@@ -0,0 +1,98 @@
+#include "Glog.h"
+#include "GlogBuffer.h"
+#include "utilities.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+using namespace glog;
+
+namespace {
+
+const size_t CACHE_SIZE = 4 * 1024 * 1024;
+const size_t LOG_SIZE = 200;
+const int ROTATIONS = 20;
+// fill most of the cache after every rotation, never trigger an archive by write
+const int LOGS_PER_ROTATION = static_cast<int>(CACHE_SIZE * 8 / 10 / (LOG_SIZE + 11));
+
+struct Result {
+    int64_t m_flushMicros; // average of one flush, includes loading new cache
+    int64_t m_p50;
+    int64_t m_p99;
+    int64_t m_p999;
+    int64_t m_max;
+    long m_faults; // minor page faults taken by writes of one rotation
+};
+
+long minorFaults() {
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+/**
+ * microseconds of every sync write after the cache is flushed and loaded again
+ */
+Result run(const std::string &directory, bool prefault, bool hugePage) {
+    std::string proto = std::string("benchmark") + (prefault ? "p" : "") + (hugePage ? "h" : "");
+    GlogConfig config;
+    config.m_protoName = proto;
+    config.m_rootDirectory = directory;
+    config.m_async = false;
+    config.m_compressMode = format::GlogCompressMode::None;
+    config.m_cacheSize = CACHE_SIZE;
+    config.m_prefaultCache = prefault;
+    config.m_hugePageCache = hugePage;
+    config.m_totalArchiveSizeLimit = 16 * CACHE_SIZE;
+    Glog *instance = Glog::maybeCreateWithConfig(config);
+
+    std::string log(LOG_SIZE, 'x');
+    std::vector<int64_t> costs;
+    costs.reserve(ROTATIONS * LOGS_PER_ROTATION);
+    int64_t flushMicros = 0;
+    long faults = 0;
+    for (int r = 0; r < ROTATIONS; ++r) {
+        instance->write(GlogBuffer((void *) log.data(), log.size()));
+        int64_t begin = cycleClockNow();
+        instance->flush();
+        flushMicros += cycleClockNow() - begin;
+
+        long faultsBegin = minorFaults();
+        for (int i = 0; i < LOGS_PER_ROTATION; ++i) {
+            begin = cycleClockNow();
+            instance->write(GlogBuffer((void *) log.data(), log.size()));
+            costs.push_back(cycleClockNow() - begin);
+        }
+        faults += minorFaults() - faultsBegin;
+    }
+    Glog::destroy(proto);
+
+    std::sort(costs.begin(), costs.end());
+    size_t n = costs.size();
+    return Result{flushMicros / ROTATIONS, costs[n / 2], costs[n * 99 / 100], costs[n * 999 / 1000], costs.back(),
+                  faults / ROTATIONS};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Glog::initialize(InternalLogLevelWarning);
+    std::string directory = argc > 1 ? argv[1] : "/tmp/glog_first_write_benchmark";
+    system(("rm -rf " + directory).c_str());
+
+    printf("%-18s %12s %10s %10s %10s %10s %10s\n", "cache", "flush (us)", "p50 (us)", "p99 (us)", "p999 (us)",
+           "max (us)", "faults");
+    for (bool hugePage : {false, true}) {
+        for (bool prefault : {false, true}) {
+            Result result = run(directory, prefault, hugePage);
+            std::string name = std::string(prefault ? "prefault" : "plain") + (hugePage ? "+hugepage" : "");
+            printf("%-18s %12lld %10lld %10lld %10lld %10lld %10ld\n", name.c_str(), (long long) result.m_flushMicros,
+                   (long long) result.m_p50, (long long) result.m_p99, (long long) result.m_p999,
+                   (long long) result.m_max, result.m_faults);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include "MessageQueue.h"
+#include "ScopedLock.h"
+#include "ThreadLock.h"
+#include "utilities.h"
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <list>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace glog;
+
+namespace {
+
+/**
+ * the list based queue before MpscRing, kept here as baseline
+ */
+class LegacyMessageQueue {
+public:
+    LegacyMessageQueue() : m_running(true), m_worker([this]() { loop(); }) {}
+
+    ~LegacyMessageQueue() {
+        {
+            SCOPED_LOCK(&m_queueLock);
+            m_running = false;
+            m_queueNotEmptyCondition.signal();
+        }
+        m_worker.join();
+    }
+
+    bool enqueue(std::function<void()> &&callback) {
+        SCOPED_LOCK(&m_queueLock);
+
+        m_queue.emplace_back(std::make_unique<std::function<void()>>(std::move(callback)));
+        m_queueNotEmptyCondition.signal();
+        return true;
+    }
+
+private:
+    std::list<std::unique_ptr<std::function<void()>>> m_queue;
+    ThreadLock m_queueLock;
+    ConditionVariable m_queueNotEmptyCondition;
+    bool m_running;
+    std::thread m_worker;
+
+    void loop() {
+        while (true) {
+            std::unique_ptr<std::function<void()>> msg;
+            {
+                SCOPED_LOCK(&m_queueLock);
+
+                if (m_running && m_queue.empty()) {
+                    m_queueNotEmptyCondition.await(m_queueLock);
+                }
+                if (!m_running && m_queue.empty()) {
+                    break;
+                }
+                if (m_queue.empty()) {
+                    continue;
+                }
+                msg = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            (*msg)();
+        }
+    }
+};
+
+const int MESSAGES_PER_PRODUCER = 200 * 1000;
+
+// old queue carries a callback per log, new one a write message, both count consumed logs in worker
+void enqueue(LegacyMessageQueue &queue, std::atomic_int &consumed) {
+    queue.enqueue([&consumed]() { consumed.fetch_add(1, std::memory_order_relaxed); });
+}
+
+void enqueue(MessageQueue &queue) {
+    static char log[] = "log";
+    queue.enqueue(Message(log, sizeof(log)));
+}
+
+template <typename Produce>
+double run(Produce produce, std::atomic_int &consumed, int producers) {
+    const int total = producers * MESSAGES_PER_PRODUCER;
+    std::vector<std::thread> threads;
+
+    int64_t begin = cycleClockNow();
+    for (int i = 0; i < producers; ++i) {
+        threads.emplace_back([&produce]() {
+            for (int j = 0; j < MESSAGES_PER_PRODUCER; ++j) {
+                produce();
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    while (consumed.load(std::memory_order_relaxed) < total) {
+        std::this_thread::yield();
+    }
+    int64_t costMicros = cycleClockNow() - begin;
+    return total / (costMicros * 0.000001);
+}
+
+} // namespace
+
+int main() {
+    printf("%-10s %18s %18s\n", "producers", "list (msg/s)", "ring (msg/s)");
+    for (int producers : {1, 2, 4, 8, 16}) {
+        double legacy;
+        double ring;
+        {
+            std::atomic_int consumed(0);
+            LegacyMessageQueue queue;
+            legacy = run([&queue, &consumed]() { enqueue(queue, consumed); }, consumed, producers);
+        }
+        {
+            std::atomic_int consumed(0);
+            MessageQueue queue(
+                MESSAGE_QUEUE_CAPACITY,
+                [&consumed](const struct iovec *, size_t num) {
+                    consumed.fetch_add(static_cast<int>(num), std::memory_order_relaxed);
+                },
+                [](const void *, size_t, format::GlogChunkType, size_t) {}, [](void *, size_t, size_t) {},
+                [](MessageType, uint32_t, void *, bool) {});
+            ring = run([&queue]() { enqueue(queue); }, consumed, producers);
+        }
+        printf("%-10d %18.0f %18.0f\n", producers, legacy, ring);
+    }
+    return 0;
+}
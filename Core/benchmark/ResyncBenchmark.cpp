@@ -0,0 +1,132 @@
+#include "Glog.h"
+#include "GlogBuffer.h"
+#include "GlogFile.h"
+#include "GlogReader.h"
+#include "utilities.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace glog;
+
+namespace {
+
+const size_t CACHE_SIZE = 16 * 1024 * 1024;
+const size_t LOG_SIZE = 200;
+const size_t LOG_NUM = 40000;
+
+// searchSyncMarkerInFile before blocks were read, one lseek and one byte read each step
+int64_t legacySearch(int fd, off_t offset, size_t size) {
+    size_t j = 0;
+    for (int64_t i = offset; i < static_cast<int64_t>(size); ++i) {
+        uint8_t byte;
+        if (::lseek(fd, i, SEEK_SET) < 0 || ::read(fd, &byte, 1) <= 0) {
+            return -1;
+        }
+        j = byte == format::SYNC_MARKER[j] ? j + 1 : (byte == format::SYNC_MARKER[0] ? 1 : 0);
+        if (j == format::SYNC_MARKER_LENGTH) {
+            return i + 1 - j;
+        }
+    }
+    return -1;
+}
+
+Glog *createInstance(const std::string &directory) {
+    GlogConfig config;
+    config.m_protoName = "benchmark";
+    config.m_rootDirectory = directory;
+    config.m_async = false;
+    config.m_compressMode = format::GlogCompressMode::None;
+    config.m_cacheSize = CACHE_SIZE;
+    return Glog::maybeCreateWithConfig(config);
+}
+
+std::string writeArchive(Glog *instance) {
+    std::string log(LOG_SIZE, 'x');
+    for (size_t i = 0; i < LOG_NUM; ++i) {
+        instance->write(GlogBuffer((void *) log.data(), log.size()));
+    }
+    instance->flush();
+    std::vector<string> archives;
+    instance->getArchiveSnapshot(archives, ArchiveCondition{true, 0, 0}, FileOrder::CreateTimeAscending);
+    return archives.empty() ? "" : archives.front();
+}
+
+// random bytes without sync marker, the marker closing the record after them is where reader resyncs
+void corrupt(const std::string &archive, off_t begin, size_t length) {
+    std::vector<uint8_t> garbage(length);
+    srand(1);
+    for (auto &byte : garbage) {
+        byte = rand();
+        if (byte == format::SYNC_MARKER[0]) {
+            byte = 0;
+        }
+    }
+    int fd = ::open(archive.c_str(), O_RDWR);
+    ::pwrite(fd, garbage.data(), length, begin);
+    ::close(fd);
+}
+
+// microseconds to read through the archive with a reader, logs read
+std::pair<int64_t, size_t> readThrough(Glog *instance, const std::string &archive) {
+    GlogReader *reader = instance->openReader(archive);
+    char buf[SINGLE_LOG_CONTENT_MAX_LENGTH];
+    size_t logs = 0;
+    int64_t begin = cycleClockNow();
+    while (true) {
+        GlogBuffer buffer(buf, sizeof(buf));
+        int n = reader->read(buffer);
+        if (n < 0) {
+            break;
+        }
+        logs += n > 0;
+    }
+    int64_t cost = cycleClockNow() - begin;
+    instance->closeReader(reader);
+    return {cost, logs};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Glog::initialize(InternalLogLevelError);
+    std::string directory = argc > 1 ? argv[1] : "/tmp/glog_resync_benchmark";
+
+    printf("%-10s %14s %14s %14s %10s\n", "corrupted", "legacy (us)", "blocked (us)", "read all (us)", "logs");
+    for (size_t length : {4 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024}) {
+        system(("rm -rf " + directory).c_str());
+        Glog *instance = createInstance(directory);
+        std::string archive = writeArchive(instance);
+        if (archive.empty()) {
+            printf("no archive\n");
+            return 1;
+        }
+        size_t size = getFileSize(archive);
+        off_t begin = static_cast<off_t>(size / 2 - length / 2);
+        corrupt(archive, begin, length);
+
+        int fd = ::open(archive.c_str(), O_RDONLY);
+        int64_t start = cycleClockNow();
+        int64_t legacyPos = legacySearch(fd, begin, size);
+        int64_t legacyCost = cycleClockNow() - start;
+        start = cycleClockNow();
+        int64_t blockedPos = searchSyncMarkerInFile(archive, fd, begin, size);
+        int64_t blockedCost = cycleClockNow() - start;
+        ::close(fd);
+        if (legacyPos != blockedPos || blockedPos < begin + static_cast<int64_t>(length)) {
+            printf("wrong result, %lld vs %lld\n", (long long) legacyPos, (long long) blockedPos);
+            return 1;
+        }
+
+        auto result = readThrough(instance, archive);
+        Glog::destroy("benchmark");
+        printf("%-10s %14lld %14lld %14lld %10zu\n", (std::to_string(length / 1024) + "KB").c_str(),
+               (long long) legacyCost, (long long) blockedCost, (long long) result.first, result.second);
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "Glog.h"
+#include "GlogBuffer.h"
+#include "utilities.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace glog;
+
+namespace {
+
+const int LOGS_PER_THREAD = 20 * 1000;
+const size_t LOG_SIZE = 200;
+
+/**
+ * sync zlib instance written by threadNum threads, return logs per second of all threads
+ */
+double run(const std::string &directory, int threadNum, size_t shardNum) {
+    std::string proto = "benchmark" + std::to_string(threadNum) + "s" + std::to_string(shardNum);
+    GlogConfig config;
+    config.m_protoName = proto;
+    config.m_rootDirectory = directory;
+    config.m_async = false;
+    config.m_incrementalArchive = true;
+    config.m_cacheShardNum = shardNum;
+    Glog *instance = Glog::maybeCreateWithConfig(config);
+
+    int64_t begin = cycleClockNow();
+    std::vector<std::thread> writers;
+    for (int t = 0; t < threadNum; ++t) {
+        writers.emplace_back([instance, t]() {
+            std::string log(LOG_SIZE, 'a' + t % 26);
+            for (int i = 0; i < LOGS_PER_THREAD; ++i) {
+                std::string seq = std::to_string(i);
+                log.replace(0, seq.size(), seq);
+                instance->write(GlogBuffer((void *) log.data(), log.size()));
+            }
+        });
+    }
+    for (auto &t : writers) {
+        t.join();
+    }
+    int64_t costMicros = cycleClockNow() - begin;
+    Glog::destroy(proto);
+    return threadNum * LOGS_PER_THREAD / (costMicros * 0.000001);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Glog::initialize(InternalLogLevelWarning);
+    std::string directory = argc > 1 ? argv[1] : "/tmp/glog_sharded_cache_benchmark";
+    system(("rm -rf " + directory).c_str());
+
+    printf("%-10s %18s %18s %18s\n", "threads", "1 shard (log/s)", "4 shards (log/s)", "8 shards (log/s)");
+    for (int threadNum : {1, 2, 4, 8}) {
+        printf("%-10d", threadNum);
+        for (size_t shardNum : {1, 4, 8}) {
+            printf(" %18.0f", run(directory, threadNum, shardNum));
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include "Glog.h"
+#include "GlogBuffer.h"
+#include "utilities.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace glog;
+
+namespace {
+
+const int LOGS_PER_INSTANCE = 20 * 1000;
+const size_t LOG_SIZE = 200;
+
+/**
+ * every instance has one producer thread, return logs per second of one instance,
+ * measured until all instances are destroyed, which waits for their queues drained.
+ */
+double run(const std::string &directory, int instanceNum, bool sharedWriter) {
+    std::vector<std::string> protos;
+    std::vector<Glog *> instances;
+    for (int i = 0; i < instanceNum; ++i) {
+        protos.emplace_back("benchmark" + std::to_string(i) + (sharedWriter ? "s" : "d"));
+        GlogConfig config;
+        config.m_protoName = protos.back();
+        config.m_rootDirectory = directory;
+        config.m_incrementalArchive = true;
+        config.m_overflowBlockTimeoutMillis = 60 * 1000;
+        config.m_sharedWriter = sharedWriter;
+        instances.push_back(Glog::maybeCreateWithConfig(config));
+    }
+    std::string log(LOG_SIZE, 'x');
+
+    int64_t begin = cycleClockNow();
+    std::vector<std::thread> producers;
+    for (Glog *instance : instances) {
+        producers.emplace_back([instance, &log]() {
+            for (int i = 0; i < LOGS_PER_INSTANCE; ++i) {
+                instance->write(GlogBuffer((void *) log.data(), log.size()));
+            }
+        });
+    }
+    for (auto &t : producers) {
+        t.join();
+    }
+    for (auto &proto : protos) {
+        Glog::destroy(proto);
+    }
+    int64_t costMicros = cycleClockNow() - begin;
+    return LOGS_PER_INSTANCE / (costMicros * 0.000001);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Glog::initialize(InternalLogLevelWarning, DEFAULT_SHARED_WRITER_NUM);
+    std::string directory = argc > 1 ? argv[1] : "/tmp/glog_shared_writer_benchmark";
+    system(("rm -rf " + directory).c_str());
+
+    printf("%-10s %22s %22s\n", "instances", "dedicated (log/s/inst)", "shared (log/s/inst)");
+    for (int instanceNum : {1, 2, 4, 8, 16}) {
+        double dedicated = run(directory, instanceNum, false);
+        double shared = run(directory, instanceNum, true);
+        printf("%-10d %22.0f %22.0f\n", instanceNum, dedicated, shared);
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "Glog.h"
+#include "GlogBuffer.h"
+#include "utilities.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace glog;
+
+namespace {
+
+const int LOG_NUM = 50 * 1000;
+const size_t LOG_SIZE = 200;
+
+struct Latency {
+    int64_t m_p50;
+    int64_t m_p99;
+    int64_t m_p999;
+    int64_t m_max;
+};
+
+// log like content, compressible but not trivially
+std::string makeLog(int seed) {
+    static const char *words[] = {"user", "click", "page", "order", "id=", "ts=", "ok", "latency", "ms", " "};
+    std::string log;
+    srand(seed);
+    while (log.size() < LOG_SIZE) {
+        log += words[rand() % 10];
+        log += std::to_string(rand() % 1000);
+    }
+    log.resize(LOG_SIZE);
+    return log;
+}
+
+/**
+ * microseconds of every sync write, the ones hitting a full cache make the tail
+ */
+Latency run(const std::string &directory, bool incremental, bool standby) {
+    std::string proto = std::string("benchmark") + (incremental ? "i" : "") + (standby ? "s" : "");
+    GlogConfig config;
+    config.m_protoName = proto;
+    config.m_rootDirectory = directory;
+    config.m_async = false;
+    config.m_incrementalArchive = incremental;
+    config.m_standbyCache = standby;
+    Glog *instance = Glog::maybeCreateWithConfig(config);
+
+    std::vector<std::string> logs;
+    for (int i = 0; i < 64; ++i) {
+        logs.emplace_back(makeLog(i));
+    }
+    std::vector<int64_t> costs(LOG_NUM);
+    for (int i = 0; i < LOG_NUM; ++i) {
+        const std::string &log = logs[i % logs.size()];
+        int64_t begin = cycleClockNow();
+        instance->write(GlogBuffer((void *) log.data(), log.size()));
+        costs[i] = cycleClockNow() - begin;
+    }
+    Glog::destroy(proto);
+
+    std::sort(costs.begin(), costs.end());
+    return Latency{costs[LOG_NUM / 2], costs[LOG_NUM * 99 / 100], costs[LOG_NUM * 999 / 1000], costs.back()};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Glog::initialize(InternalLogLevelWarning);
+    std::string directory = argc > 1 ? argv[1] : "/tmp/glog_standby_cache_benchmark";
+    system(("rm -rf " + directory).c_str());
+
+    printf("%-18s %10s %10s %10s %10s\n", "cache", "p50 (us)", "p99 (us)", "p999 (us)", "max (us)");
+    for (bool incremental : {false, true}) {
+        for (bool standby : {false, true}) {
+            Latency latency = run(directory, incremental, standby);
+            std::string name = std::string(incremental ? "incr" : "archive") + (standby ? "+standby" : "");
+            printf("%-18s %10lld %10lld %10lld %10lld\n", name.c_str(), (long long) latency.m_p50,
+                   (long long) latency.m_p99, (long long) latency.m_p999, (long long) latency.m_max);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "Glog.h"
+#include "GlogFile.h"
+#include "utilities.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace glog;
+
+namespace {
+
+const size_t BUFFER_SIZE = 8 * 1024 * 1024;
+const int REPEAT = 10;
+
+/**
+ * GB/s of searching a sync marker put at the very end of buffer, the whole buffer is scanned
+ */
+double run(const std::vector<uint8_t> &buffer, const std::function<int64_t(const uint8_t *, size_t)> &search) {
+    int64_t expected = static_cast<int64_t>(buffer.size() - format::SYNC_MARKER_LENGTH);
+    int64_t begin = cycleClockNow();
+    for (int i = 0; i < REPEAT; ++i) {
+        if (search(buffer.data(), buffer.size()) != expected) {
+            printf("wrong result\n");
+            exit(1);
+        }
+    }
+    int64_t costMicros = cycleClockNow() - begin;
+    return static_cast<double>(buffer.size()) * REPEAT / (costMicros * 1000.0);
+}
+
+// corrupted log bytes: random, marker bytes a bit more often than others
+std::vector<uint8_t> makeCorrupted() {
+    std::vector<uint8_t> buffer(BUFFER_SIZE);
+    srand(1);
+    for (auto &byte : buffer) {
+        byte = rand() % 8 == 0 ? format::SYNC_MARKER[rand() % format::SYNC_MARKER_LENGTH] : rand();
+    }
+    return buffer;
+}
+
+// zeros after write position of a cache
+std::vector<uint8_t> makeZeros() {
+    return std::vector<uint8_t>(BUFFER_SIZE, 0);
+}
+
+} // namespace
+
+int main() {
+    Glog::initialize(InternalLogLevelWarning);
+
+    const SyncMarkerSearch best = bestSyncMarkerSearch();
+    std::vector<std::pair<std::string, std::function<int64_t(const uint8_t *, size_t)>>> searches = {
+        {"kmp", [](const uint8_t *haystack, size_t len) {
+             return searchNeedle(haystack, len, format::SYNC_MARKER, format::SYNC_MARKER_LENGTH, false);
+         }}};
+    const std::pair<SyncMarkerSearch, const char *> candidates[] = {{SyncMarkerSearch::Scalar, "scalar"},
+                                                                    {SyncMarkerSearch::SSE2, "sse2"},
+                                                                    {SyncMarkerSearch::AVX2, "avx2"},
+                                                                    {SyncMarkerSearch::NEON, "neon"}};
+    for (const auto &candidate : candidates) {
+        SyncMarkerSearch search = candidate.first;
+#if !defined(__x86_64__) && !defined(__i386__)
+        if (search == SyncMarkerSearch::SSE2) {
+            continue;
+        }
+#endif
+        if (search != SyncMarkerSearch::Scalar && search != SyncMarkerSearch::SSE2 && search != best) {
+            continue;
+        }
+        searches.emplace_back(candidate.second, [search](const uint8_t *haystack, size_t len) {
+            return findSyncMarker(haystack, len, search);
+        });
+    }
+
+    std::vector<uint8_t> corrupted = makeCorrupted();
+    std::vector<uint8_t> zeros = makeZeros();
+    // no marker by chance before the one at the end
+    for (size_t i = 0; i + format::SYNC_MARKER_LENGTH <= corrupted.size(); ++i) {
+        if (memcmp(corrupted.data() + i, format::SYNC_MARKER, format::SYNC_MARKER_LENGTH) == 0) {
+            corrupted[i] = 0;
+        }
+    }
+    memcpy(corrupted.data() + BUFFER_SIZE - format::SYNC_MARKER_LENGTH, format::SYNC_MARKER,
+           format::SYNC_MARKER_LENGTH);
+    memcpy(zeros.data() + BUFFER_SIZE - format::SYNC_MARKER_LENGTH, format::SYNC_MARKER, format::SYNC_MARKER_LENGTH);
+
+    printf("%-10s %16s %16s\n", "search", "corrupted (GB/s)", "zeros (GB/s)");
+    for (const auto &pair : searches) {
+        printf("%-10s %16.2f %16.2f\n", pair.first.c_str(), run(corrupted, pair.second), run(zeros, pair.second));
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "Glog.h"
+#include "GlogBuffer.h"
+#include "GlogReader.h"
+#include "utilities.h"
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <string>
+#include <vector>
+
+using namespace glog;
+
+namespace {
+
+const size_t LOG_SIZE = 100;
+const size_t TAIL_LOGS = 100;
+
+struct Result {
+    int64_t m_micros;
+    size_t m_logs;
+};
+
+// one archive of about archiveSize bytes
+string writeArchive(Glog *instance, size_t archiveSize) {
+    std::string log(LOG_SIZE, 'x');
+    for (size_t i = 0; i < archiveSize / (LOG_SIZE + 11); ++i) {
+        std::string index = std::to_string(i);
+        log.replace(0, index.size(), index);
+        instance->write(GlogBuffer((void *) log.data(), log.size()));
+    }
+    instance->flush();
+    std::vector<string> archives;
+    instance->getArchiveSnapshot(archives, ArchiveCondition{true, 0, 0}, FileOrder::CreateTimeAscending);
+    return archives.empty() ? "" : archives.back();
+}
+
+// the last TAIL_LOGS logs by reading the whole archive
+Result readTailForward(Glog *instance, const string &archive) {
+    std::vector<uint8_t> buffer(SINGLE_LOG_CONTENT_MAX_LENGTH);
+    std::deque<std::string> tail;
+    int64_t begin = cycleClockNow();
+    GlogReader *reader = instance->openReader(archive);
+    while (true) {
+        int n = reader->read(buffer.data(), buffer.size());
+        if (n < 0) {
+            break;
+        }
+        tail.emplace_back(reinterpret_cast<char *>(buffer.data()), n);
+        if (tail.size() > TAIL_LOGS) {
+            tail.pop_front();
+        }
+    }
+    instance->closeReader(reader);
+    return Result{cycleClockNow() - begin, tail.size()};
+}
+
+// the last TAIL_LOGS logs newest first
+Result readTailBackward(Glog *instance, const string &archive) {
+    std::vector<uint8_t> buffer(SINGLE_LOG_CONTENT_MAX_LENGTH);
+    std::vector<std::string> tail;
+    int64_t begin = cycleClockNow();
+    GlogReader *reader = instance->openReader(archive);
+    while (tail.size() < TAIL_LOGS) {
+        int n = reader->readBackward(buffer.data(), buffer.size());
+        if (n < 0) {
+            break;
+        }
+        tail.emplace_back(reinterpret_cast<char *>(buffer.data()), n);
+    }
+    instance->closeReader(reader);
+    return Result{cycleClockNow() - begin, tail.size()};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Glog::initialize(InternalLogLevelWarning);
+    std::string directory = argc > 1 ? argv[1] : "/tmp/glog_tail_read_benchmark";
+    system(("rm -rf " + directory).c_str());
+
+    printf("%-8s %-12s %14s %14s %8s\n", "archive", "mode", "forward (us)", "backward (us)", "logs");
+    for (size_t cacheSize : {1024 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024}) {
+        // zlib with shards is reset every record, without shards every cache appended to archive starts a stream
+        for (int mode = 0; mode < 4; ++mode) {
+            GlogConfig config;
+            config.m_protoName = "benchmark" + std::to_string(cacheSize / 1024) + "-" + std::to_string(mode);
+            config.m_rootDirectory = directory;
+            config.m_async = false;
+            config.m_compressMode = mode == 0 ? format::GlogCompressMode::None : format::GlogCompressMode::Zlib;
+            config.m_cacheShardNum = mode == 2 ? 4 : 1;
+            config.m_incrementalArchive = mode == 3;
+            config.m_cacheSize = mode == 3 ? 256 * 1024 : cacheSize;
+            Glog *instance = Glog::maybeCreateWithConfig(config);
+            string archive = writeArchive(instance, cacheSize * 9 / 10);
+
+            Result forward = readTailForward(instance, archive);
+            Result backward = readTailBackward(instance, archive);
+            const char *modeNames[] = {"none", "zlib", "zlib-shard", "zlib-incr"};
+            const char *modeName = modeNames[mode];
+            printf("%-8s %-12s %14lld %14lld %8zu\n", (std::to_string(cacheSize / 1024 / 1024) + "MB").c_str(),
+                   modeName, (long long) forward.m_micros, (long long) backward.m_micros, backward.m_logs);
+            Glog::destroy(config.m_protoName);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "Glog.h"
+#include "GlogFile.h"
+#include "ZlibCompress.h"
+#include "utilities.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace glog;
+
+namespace {
+
+// bytes written for each record size, at most 100k records
+const size_t BYTES_PER_ROUND = 16 * 1024 * 1024;
+const size_t MAX_RECORDS_PER_ROUND = 100 * 1000;
+const char *SERVER_PUBLIC_KEY = "41B5F5F9A53684A1C09B931B7BDF7D7C3959BC7FB31827ADBE1524DDC8F2D90AD4978891385D956CE817B293FC57CF07A4EC3DAF03F63852D75A32A956B84176";
+
+struct Mode {
+    const char *m_name;
+    format::GlogCompressMode m_compressMode;
+    format::GlogEncryptMode m_encryptMode;
+};
+
+// log like content, compressible but not trivially
+std::string makeRecord(size_t size, unsigned seed) {
+    static const char *words[] = {"user", "click", "page", "order", "id=", "ts=", "ok", "latency", "ms", " "};
+    std::string record;
+    srand(seed);
+    while (record.size() < size) {
+        record += words[rand() % 10];
+        record += std::to_string(rand() % 1000);
+    }
+    record.resize(size);
+    return record;
+}
+
+/**
+ * nanoseconds per GlogFile::writeLogData, cache is reset instead of archived when it is full
+ */
+double run(const std::string &directory, const Mode &mode, size_t recordSize) {
+    ZlibCompressor compressor;
+    std::string publicKey = SERVER_PUBLIC_KEY;
+    GlogFile file(directory + "/benchmark.glogmmap", "benchmark", calculateRoundCacheSize(), &compressor,
+                  mode.m_compressMode, mode.m_encryptMode, &publicKey);
+    std::vector<std::string> records;
+    for (unsigned i = 0; i < 16; ++i) {
+        records.emplace_back(makeRecord(recordSize, i));
+    }
+    auto resetCache = [&](uint32_t) {
+        file.resetInternalState();
+        compressor.reset();
+        return true;
+    };
+
+    size_t recordNum = std::min(BYTES_PER_ROUND / recordSize, MAX_RECORDS_PER_ROUND);
+    int64_t begin = cycleClockNow();
+    for (size_t i = 0; i < recordNum; ++i) {
+        const std::string &record = records[i % records.size()];
+        GlogBuffer buffer((void *) record.data(), record.size());
+        file.writeLogData(buffer, resetCache);
+    }
+    int64_t costMicros = cycleClockNow() - begin;
+    return costMicros * 1000.0 / recordNum;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Glog::initialize(InternalLogLevelWarning);
+    std::string directory = argc > 1 ? argv[1] : "/tmp";
+
+    const Mode modes[] = {
+        {"plain", format::GlogCompressMode::None, format::GlogEncryptMode::None},
+        {"aes", format::GlogCompressMode::None, format::GlogEncryptMode::AES},
+        {"zlib", format::GlogCompressMode::Zlib, format::GlogEncryptMode::None},
+        {"zlib+aes", format::GlogCompressMode::Zlib, format::GlogEncryptMode::AES},
+    };
+    printf("%-10s %14s %14s %14s\n", "mode", "64B (ns)", "512B (ns)", "4KB (ns)");
+    for (auto &mode : modes) {
+        printf("%-10s", mode.m_name);
+        for (size_t recordSize : {64, 512, 4096}) {
+            printf(" %14.0f", run(directory, mode, recordSize));
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -48,6 +48,11 @@ uint32_t reverseU32(uint32_t value) {
             ((value & 0xFF000000) >> 24));
 }
 
+uint64_t reverseU64(uint64_t value) {
+    return (static_cast<uint64_t>(reverseU32(static_cast<uint32_t>(value))) << 32) |
+           reverseU32(static_cast<uint32_t>(value >> 32));
+}
+
 uint16_t toLittleEndianU16(uint16_t value) {
     return SYS_ENDIAN == Endianness::BigEndian ? reverseU16(value) : value;
 }
@@ -56,10 +61,18 @@ uint32_t toLittleEndianU32(uint32_t value) {
     return SYS_ENDIAN == Endianness::BigEndian ? reverseU32(value) : value;
 }
 
+uint64_t toLittleEndianU64(uint64_t value) {
+    return SYS_ENDIAN == Endianness::BigEndian ? reverseU64(value) : value;
+}
+
 uint16_t readU16Le(uint16_t value) {
     return SYS_ENDIAN == Endianness::BigEndian ? reverseU16(value) : value;
 }
 
+uint64_t readU64Le(uint64_t value) {
+    return SYS_ENDIAN == Endianness::BigEndian ? reverseU64(value) : value;
+}
+
 //void generateSync(uint8_t out[]) {
 //    uuid_t u_t = {0};
 //    char uuid[36];
@@ -189,6 +202,20 @@ bool getFileCreateTime(const string &path, int64_t &epochMillis) {
     return true;
 }
 
+bool getFileModifyTime(const string &path, int64_t &epochMillis) {
+    struct stat st {};
+    if (::stat(path.c_str(), &st) != 0) {
+        InternalWarning("%s : %s", path.c_str(), strerror(errno));
+        return false;
+    }
+#ifndef GLOG_ANDROID
+    epochMillis = (int64_t) st.st_mtimespec.tv_sec * 1000 + st.st_mtimespec.tv_nsec / 1000000;
+#else
+    epochMillis = (int64_t) st.st_mtim.tv_sec * 1000 + st.st_mtim.tv_nsec / 1000000;
+#endif // GLOG_ANDROID
+    return true;
+}
+
 constexpr char HEX_TABLE[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
 
 string hex2Str(const uint8_t *data, int len) {
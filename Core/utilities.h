@@ -39,12 +39,18 @@ uint16_t reverseU16(uint16_t value);
 
 uint32_t reverseU32(uint32_t value);
 
+uint64_t reverseU64(uint64_t value);
+
 uint16_t toLittleEndianU16(uint16_t value);
 
 uint32_t toLittleEndianU32(uint32_t value);
 
+uint64_t toLittleEndianU64(uint64_t value);
+
 uint16_t readU16Le(uint16_t value);
 
+uint64_t readU64Le(uint64_t value);
+
 //void generateSync(uint8_t out[]);
 
 bool getFileSize(int fd, size_t &size);
@@ -69,6 +75,8 @@ bool isDirectory(const string &path);
 // TODO in fact it's the file's last modified time
 bool getFileCreateTime(const string &path, int64_t &epochMillis);
 
+bool getFileModifyTime(const string &path, int64_t &epochMillis);
+
 string hex2Str(const uint8_t *data, int len);
 
 int char2int(char input);
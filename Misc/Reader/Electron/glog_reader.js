@@ -12,6 +12,8 @@ module.exports.createGlogReader = (bytes, key) => new GlogReader(bytes, key);
 
 const GlogRecoveryVersion = 0x3;
 const GlogCipherVersion = 0x4;
+// log longer than SINGLE_LOG_CONTENT_MAX_LENGTH is split into chunk records, v4 file is a v6 file without chunks
+const GlogChunkVersion = 0x6;
 
 const COMPRESS_NONE_V3 = 0;
 const COMPRESS_ZLIB_V3 = 1;
@@ -25,6 +27,12 @@ const COMPRESS_ZLIB_V4 = 2;
 const ENCRYPT_NONE_V4 = 1;
 const ENCRYPT_AES_V4 = 2;
 
+// chunk type in high 2 bits of mode set since v6
+const CHUNK_WHOLE = 0;
+const CHUNK_FIRST = 1;
+const CHUNK_MIDDLE = 2;
+const CHUNK_LAST = 3;
+
 const MAGIC_NUMBER = new Uint8Array([0x1B, 0xAD, 0xC0, 0xDE]);
 
 const SINGLE_LOG_CONTENT_MAX_LENGTH = 16 * 1024;
@@ -225,6 +233,7 @@ class FileReaderV4 extends FileReader {
         super(content, position);
         this.svrPriKey = svrPriKey;
         this.ec = new EC('secp256k1');
+        this.chunkType = CHUNK_WHOLE;
     }
 
     readRemainHeader() {
@@ -246,14 +255,48 @@ class FileReaderV4 extends FileReader {
         console.log("Read header v4 done, position:", this.position);
     }
 
+    // chunks of long log are put together
     read() {
+        let chunks = [];
+        for (; ;) {
+            const ret = this.readRecord();
+            if (ret[0] <= 0) {
+                if (chunks.length > 0) {
+                    console.warn("file broken at position:%d, drop part of long log", this.position);
+                }
+                return ret;
+            }
+            if (this.chunkType == CHUNK_MIDDLE || this.chunkType == CHUNK_LAST) {
+                if (chunks.length == 0) {
+                    // first one is in another file or broken
+                    console.warn("skip chunk without first one at position:%d", this.position);
+                    continue;
+                }
+            } else if (chunks.length > 0) {
+                console.warn("file broken before position:%d, drop part of long log", this.position);
+                chunks = [];
+            }
+            if (this.chunkType == CHUNK_WHOLE) {
+                return ret;
+            }
+            // inflate output may be reused by next record
+            chunks.push(Buffer.from(ret[1]));
+            if (this.chunkType == CHUNK_LAST) {
+                const data = Buffer.concat(chunks);
+                return [data.length, data];
+            }
+        }
+    }
+
+    readRecord() {
         if (this.spaceRemain() < 2 + 1 + 8) {
             return [-1, null];
         }
         let compressMode = 0;
         let encryptMode = 0;
 
-        switch (this.content[this.position] >> 4) {
+        this.chunkType = this.content[this.position] >> 6;
+        switch ((this.content[this.position] >> 4) & 0x03) {
             case COMPRESS_NONE_V4:
                 compressMode = COMPRESS_NONE_V4;
                 break;
@@ -261,7 +304,7 @@ class FileReaderV4 extends FileReader {
                 compressMode = COMPRESS_ZLIB_V4;
                 break;
             default:
-                console.warn("Illegal compress mode:", this.content[this.position] >> 4);
+                console.warn("Illegal compress mode:", (this.content[this.position] >> 4) & 0x03);
                 this.position++;
                 return this.tryRecover(-2);
         }
@@ -404,6 +447,7 @@ class GlogReader {
                 this.fileReader = new FileReaderV3(content, cur);
                 break;
             case GlogCipherVersion:
+            case GlogChunkVersion:
                 this.fileReader = new FileReaderV4(content, cur, key);
                 break;
             default:
@@ -68,6 +68,10 @@ import java.util.Arrays;
 +-----------------------------------------------------------------+
 |                              ...
 +-----------------------------------------------------------------+
+*
+* mode set: chunk type (2 bits) | compress mode (2 bits) | encrypt mode (4 bits)
+* v6 splits log longer than single log max length into records of chunk type First, Middle..., Last,
+* single record log has chunk type Whole (0), so v4 file reads the same.
 */
 public class FileReaderV4 extends FileReader {
     private enum CompressMode {
@@ -92,11 +96,20 @@ public class FileReaderV4 extends FileReader {
         }
     }
 
+    private enum ChunkType {
+        Whole,
+        First,
+        Middle,
+        Last
+    }
+
     private static final char[] HEX_TABLE = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
 
 
     private final String svrPriKey;
     private final ECPrivateKey svrEcPriKey;
+    private final byte[] chunkBuf = new byte[GlogReader.SINGLE_LOG_CONTENT_MAX_LENGTH];
+    private ChunkType chunkType = ChunkType.Whole;
 
     protected FileReaderV4(FileInputStream input, String key) throws IOException {
         super(input);
@@ -127,15 +140,55 @@ public class FileReaderV4 extends FileReader {
         position += 4 + 1 + 2 + protoNameLen + 8;
     }
 
+    /**
+     * chunks of long log are put together, return -8 if log is longer than outBufLen, all its chunks are consumed
+     */
     @Override
     public int read(byte[] outBuf, int outBufLen) throws IOException {
+        int length = 0;
+        boolean chunked = false;
+        boolean overflow = false;
+        while (true) {
+            int n = readRecord(chunkBuf, chunkBuf.length);
+            if (n <= 0) {
+                return n;
+            }
+            if (chunkType == ChunkType.Middle || chunkType == ChunkType.Last) {
+                if (!chunked) {
+                    logger.warning("Skip chunk without first one"); // first one is in another file or broken
+                    continue;
+                }
+            } else {
+                // rest of long log in progress is lost, start over with this one
+                length = 0;
+                overflow = false;
+            }
+            if (length + n > outBufLen) {
+                overflow = true;
+            } else if (!overflow) {
+                System.arraycopy(chunkBuf, 0, outBuf, length, n);
+            }
+            length += n;
+            chunked = chunkType == ChunkType.First || chunkType == ChunkType.Middle;
+            if (!chunked) {
+                if (overflow) {
+                    logger.warning("Log length:" + length + " exceeds buffer length:" + outBufLen + ", skip it");
+                    return -8;
+                }
+                return length;
+            }
+        }
+    }
+
+    private int readRecord(byte[] outBuf, int outBufLen) throws IOException {
         if (input.available() < 2 + 1 + 8) {
             return -1;
         }
         final int ms = input.read();
         CompressMode compressMode;
         EncryptMode encryptMode;
-        switch (ms >> 4) {
+        chunkType = ChunkType.values()[ms >> 6];
+        switch ((ms >> 4) & 0x03) {
             case 1:
                 compressMode = CompressMode.None;
                 break;
@@ -143,7 +196,7 @@ public class FileReaderV4 extends FileReader {
                 compressMode = CompressMode.Zlib;
                 break;
             default:
-                logger.warning("Illegal compress mode:" + (ms >> 4)); // todo recover
+                logger.warning("Illegal compress mode:" + ((ms >> 4) & 0x03)); // todo recover
                 return -2;
         }
 
@@ -36,6 +36,7 @@ public class GlogReader implements Closeable {
                 fileReader = new FileReaderV3(input);
                 break;
             case GlogVersion.GlogCipherVersion:
+            case GlogVersion.GlogChunkVersion:
                 fileReader = new FileReaderV4(input, key);
                 break;
             default:
@@ -20,4 +20,9 @@ public interface GlogVersion {
      * store iv and public key in each log to support AES CFB-128 encrypt
      */
     int GlogCipherVersion = 0x4;
+
+    /**
+     * split log longer than single log max length into chunk records
+     */
+    int GlogChunkVersion = 0x6;
 }
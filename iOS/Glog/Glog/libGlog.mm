@@ -77,12 +77,14 @@ static recursive_mutex *g_instanceMutex;
 
 #pragma mark ------------------- glog write -------------------
 
+// log longer than 16KB is split into chunks, reader puts them together. hard limits, longer log is not written:
+// without incremental archive the whole log must fit in one cache (about 7/8 of cache size with compression),
+// in async mode it must fit in about 64MB.
 - (bool)write:(NSData *)data {
     if (!data) {
         return NO;
     }
-    glog::GlogBuffer buffer((void *) [data bytes], data.length, true);
-    return ((glog::Glog *)self.m_glog)->write(buffer);
+    return ((glog::Glog *)self.m_glog)->write([data bytes], data.length);
 }
 
 #pragma mark ------------------- glog read -------------------
@@ -97,16 +99,24 @@ static recursive_mutex *g_instanceMutex;
         glog::GlogReader *reader = ((glog::Glog *)self.m_glog)->openReader([archiveFile UTF8String], &privKey);
         NSInteger length = 0;
         glog::GlogBuffer outBuf(glog::SINGLE_LOG_CONTENT_MAX_LENGTH);
+        glog::format::GlogChunkType chunkType;
+        NSMutableData *log = [NSMutableData new];
         NSMutableArray *dataArr = [NSMutableArray new];
         do {
-            length = reader->read(outBuf);
+            // chunk by chunk, long log is put together here
+            length = reader->readChunk(outBuf, chunkType);
             if (length == 0) {
                 continue;
             } else if (length < 0) {
                 break;
             }
-            NSData *data = [NSData dataWithBytes:outBuf.getPtr() length:length];
-            [dataArr addObject:data];
+            if (chunkType == glog::format::GlogChunkType::Whole || chunkType == glog::format::GlogChunkType::First) {
+                [log setLength:0];
+            }
+            [log appendBytes:outBuf.getPtr() length:length];
+            if (chunkType == glog::format::GlogChunkType::Whole || chunkType == glog::format::GlogChunkType::Last) {
+                [dataArr addObject:[log copy]];
+            }
         } while (true);
         ((glog::Glog *)self.m_glog)->closeReader(reader);
         return dataArr;
@@ -46,12 +46,23 @@
         return -1;
     }
     glog::GlogBuffer outBuf(glog::SINGLE_LOG_CONTENT_MAX_LENGTH);
-    NSInteger length = self.m_reader->read(outBuf);
-    if (length <= 0) {
-        return length;
+    glog::format::GlogChunkType chunkType;
+    NSMutableData *log = [NSMutableData new];
+    while (true) {
+        // chunk by chunk, long log is put together here
+        NSInteger length = self.m_reader->readChunk(outBuf, chunkType);
+        if (length <= 0) {
+            return length;
+        }
+        if (chunkType == glog::format::GlogChunkType::Whole || chunkType == glog::format::GlogChunkType::First) {
+            [log setLength:0];
+        }
+        [log appendBytes:outBuf.getPtr() length:length];
+        if (chunkType == glog::format::GlogChunkType::Whole || chunkType == glog::format::GlogChunkType::Last) {
+            *data = log;
+            return log.length;
+        }
     }
-    *data = [NSData dataWithBytes:outBuf.getPtr() length:length];
-    return length;
 }
 
 @end